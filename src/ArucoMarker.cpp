@@ -8,8 +8,9 @@
 
 #include "ArucoMarker.h"
 
-ArucoMarker::ArucoMarker(int inId):
+ArucoMarker::ArucoMarker(int inId, Clock *c):
 	id(inId),
+	clock(c),
 	cvFramerate(0),
 	lastCameraUpdateTime(0)
 {}
@@ -17,7 +18,7 @@ ArucoMarker::ArucoMarker(int inId):
 ArucoMarker::ArucoMarker(): ArucoMarker(-1) {}
 
 void ArucoMarker::updateCamera(const ofVec2f &imPos, const ofVec2f &imUp) {
-	const float now = ofGetElapsedTimef();
+	const float now = clock->now();
 	const float dt = now - lastCameraUpdateTime;
 
 	imgPos = imPos;
@@ -10,15 +10,17 @@
 #define ArucoMarker_h
 
 #include "ofMain.h"
+#include "Clock.h"
 
 class ArucoMarker {
 public:
 	ArucoMarker();
-	ArucoMarker(int id);
+	ArucoMarker(int id, Clock *clock = Clock::real());
 
 	void updateCamera(const ofVec2f &imPos, const ofVec2f &imUp);
 
 	int id;
+	Clock *clock;
 
 	// From openCV
 	ofVec2f imgPos, upVec;
@@ -0,0 +1,126 @@
+//
+//  Assignment.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "Assignment.h"
+
+#include <limits>
+
+vector<int> minCostAssignment(const vector<vector<float>> &cost) {
+	const int rows = cost.size();
+	if (rows == 0) {
+		return vector<int>();
+	}
+	const int cols = cost[0].size();
+	const double inf = numeric_limits<double>::infinity();
+
+	// Potentials u, v and the row matched to each column, 1-based with
+	// column 0 as the free row being added
+	vector<double> u(rows + 1, 0), v(cols + 1, 0);
+	vector<int> rowOfCol(cols + 1, 0), prev(cols + 1, 0);
+
+	for (int row = 1; row <= rows; ++row) {
+		rowOfCol[0] = row;
+		int col0 = 0;
+		vector<double> minSlack(cols + 1, inf);
+		vector<bool> used(cols + 1, false);
+
+		// Grow an alternating path until it reaches a free column
+		do {
+			used[col0] = true;
+			const int r = rowOfCol[col0];
+			double delta = inf;
+			int col1 = 0;
+			for (int c = 1; c <= cols; ++c) {
+				if (used[c]) continue;
+
+				const double slack = cost[r - 1][c - 1] - u[r] - v[c];
+				if (slack < minSlack[c]) {
+					minSlack[c] = slack;
+					prev[c] = col0;
+				}
+				if (minSlack[c] < delta) {
+					delta = minSlack[c];
+					col1 = c;
+				}
+			}
+
+			for (int c = 0; c <= cols; ++c) {
+				if (used[c]) {
+					u[rowOfCol[c]] += delta;
+					v[c] -= delta;
+				} else {
+					minSlack[c] -= delta;
+				}
+			}
+			col0 = col1;
+		} while (rowOfCol[col0] != 0);
+
+		// Flip the path
+		do {
+			const int col1 = prev[col0];
+			rowOfCol[col0] = rowOfCol[col1];
+			col0 = col1;
+		} while (col0 != 0);
+	}
+
+	vector<int> colOfRow(rows, -1);
+	for (int c = 1; c <= cols; ++c) {
+		if (rowOfCol[c] > 0) {
+			colOfRow[rowOfCol[c] - 1] = c - 1;
+		}
+	}
+	return colOfRow;
+}
+
+vector<int> minMaxCostAssignment(const vector<vector<float>> &cost) {
+	if (cost.empty()) {
+		return vector<int>();
+	}
+
+	vector<float> levels;
+	for (auto &row : cost) {
+		levels.insert(levels.end(), row.begin(), row.end());
+	}
+	sort(levels.begin(), levels.end());
+	levels.erase(unique(levels.begin(), levels.end()), levels.end());
+
+	// Anything over the limit costs more than every allowed pairing together
+	float total = 0;
+	for (auto &row : cost) {
+		total += *max_element(row.begin(), row.end());
+	}
+	const float penalty = total + 1;
+
+	auto limited = [&](float limit) {
+		vector<vector<float>> capped = cost;
+		for (auto &row : capped) {
+			for (float &c : row) {
+				if (c > limit) c += penalty;
+			}
+		}
+		return capped;
+	};
+	auto feasible = [&](const vector<int> &match, float limit) {
+		for (int r = 0; r < match.size(); ++r) {
+			if (cost[r][match[r]] > limit) return false;
+		}
+		return true;
+	};
+
+	// Smallest limit that still lets every row be matched
+	int lo = 0, hi = levels.size() - 1;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (feasible(minCostAssignment(limited(levels[mid])), levels[mid])) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return minCostAssignment(limited(levels[lo]));
+}
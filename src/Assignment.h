@@ -0,0 +1,22 @@
+//
+//  Assignment.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef Assignment_h
+#define Assignment_h
+
+#include "ofMain.h"
+
+// Matches each row (robot) to a distinct column (target) for the lowest
+// total cost, Hungarian method in O(rows^2 * cols). Needs rows <= cols.
+// Returns the column for each row.
+vector<int> minCostAssignment(const vector<vector<float>> &cost);
+
+// Lowest possible maximum cost first, then the lowest total among those.
+vector<int> minMaxCostAssignment(const vector<vector<float>> &cost);
+
+#endif /* Assignment_h */
@@ -0,0 +1,371 @@
+//
+//  Benchmark.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "Benchmark.h"
+#include "Robot.h"
+#include "Map.h"
+#include "MapGenerator.h"
+#include "Simulator.h"
+#include "ofApp.h"
+
+#include <fstream>
+#include <random>
+
+static const double kControlBudgetUs = 5000.0;
+
+// Same canvas as the app
+static const float kMapWidthM = 1.0f;
+static const float kMapHeightM = 1.0f;
+static const float kMapOffsetXM = -kMapWidthM / 2.0;
+static const float kMapOffsetYM = -kMapHeightM / 2.0;
+static const ofRectangle kCropBox(ofVec2f(-0.45, -0.4), ofVec2f(0.45, 0.4));
+
+static const int kMapRepeats = 3;
+
+static const float kJobTickSec = 1.0 / 60.0;
+static const float kJobStallSec = 600;
+static const float kJobMaxSec = 12 * 3600;
+
+BenchmarkStats benchmarkStats(vector<double> samples) {
+	BenchmarkStats stats = { 0, 0, 0, 0 };
+	if (samples.empty()) {
+		return stats;
+	}
+
+	sort(samples.begin(), samples.end());
+	for (double s : samples) {
+		stats.mean += s;
+	}
+	stats.mean /= samples.size();
+	stats.p50 = samples[samples.size() / 2];
+	stats.p99 = samples[min(samples.size() - 1, (size_t)(samples.size() * 0.99))];
+	stats.max = samples.back();
+	return stats;
+}
+
+static void printTimingLine(const string &name, int iterations, const BenchmarkStats &stats) {
+	printf("{\"benchmark\":\"%s\",\"iterations\":%d,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f,\"budget_us\":%.0f,\"within_budget\":%s}\n",
+		   name.c_str(), iterations, stats.mean, stats.p50, stats.p99, stats.max,
+		   kControlBudgetUs, stats.max < kControlBudgetUs ? "true" : "false");
+}
+
+int runControllerBenchmark(int iterations) {
+	mt19937 rng(1);
+	uniform_real_distribution<float> offset(-0.02, 0.02), pos(-0.4, 0.4);
+
+	SimClock clock;
+	Robot r(0, -1, "benchmark", &clock);
+	r.logging = false;
+	r.lineController = LC_MPC;
+
+	vector<double> solveUs, stepUs;
+	solveUs.reserve(iterations);
+	stepUs.reserve(iterations);
+
+	char buf[128];
+	volatile float sink = 0;
+	for (int i = 0; i < iterations; ++i) {
+		if (i % 100 == 0) {
+			r.drawLine(ofVec2f(pos(rng), pos(rng)), ofVec2f(pos(rng), pos(rng)));
+		}
+		r.planePos = r.startPlanePos.getInterpolated(r.targetPlanePos, (i % 100) / 100.0f) + ofVec2f(offset(rng), offset(rng));
+
+		auto t0 = chrono::steady_clock::now();
+		sink = sink + r.lineMPC.solve(offset(rng), 0.2, 1.0 / 60.0);
+		auto t1 = chrono::steady_clock::now();
+
+		bool shouldSend = false;
+		r.moveRobot(buf, true, 1.0 / 60.0, shouldSend);
+		auto t2 = chrono::steady_clock::now();
+		clock.advance(1.0 / 60.0);
+
+		solveUs.push_back(chrono::duration<double, micro>(t1 - t0).count());
+		stepUs.push_back(chrono::duration<double, micro>(t2 - t1).count());
+	}
+
+	printTimingLine("mpc_solve", iterations, benchmarkStats(solveUs));
+	printTimingLine("mpc_move_robot", iterations, benchmarkStats(stepUs));
+	return 0;
+}
+
+template <typename F>
+static double timeMs(F f) {
+	auto t0 = chrono::steady_clock::now();
+	f();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// Best of a few runs, each on a freshly loaded map when asked.
+template <typename F>
+static double bestOfMs(Map &map, const string &path, bool reload, F f) {
+	double best = INFINITY;
+	for (int i = 0; i < kMapRepeats; ++i) {
+		if (reload) {
+			map.loadMap(path);
+		}
+		best = min(best, timeMs([&]() { f(); }));
+	}
+	return best;
+}
+
+static void benchmarkMap(const string &generator, int size, const string &path, ostream &out) {
+	Map map(kMapWidthM, kMapHeightM, kMapOffsetXM, kMapOffsetYM, kCropBox);
+	// Load the raw segments, simplification is timed on its own
+	const float simplifyTolerance = map.simplifyToleranceM;
+	map.simplifyToleranceM = 0;
+
+	const double loadMs = bestOfMs(map, path, false, [&]() { map.loadMap(path); });
+	const int segments = map.getPathCount();
+
+	const double rescaleMs = bestOfMs(map, path, true, [&]() {
+		map.rescaleMap(kMapWidthM, kMapHeightM, kMapOffsetXM, kMapOffsetYM);
+	});
+
+	int simplifiedSegments = 0;
+	const double simplifyMs = bestOfMs(map, path, true, [&]() {
+		simplifiedSegments = map.simplifyPaths(simplifyTolerance).after;
+	});
+
+	int optimizedSegments = 0;
+	const double optimizeMs = bestOfMs(map, path, true, [&]() {
+		map.optimizePaths(6);
+		optimizedSegments = map.getPathCount();
+	});
+
+	// One robot drawing everything, always taking the nearest segment.
+	int nextPathCalls = 0;
+	const double nextPathMs = bestOfMs(map, path, true, [&]() {
+		set<string> types(map.pathTypes.begin(), map.pathTypes.end());
+		ofVec2f pos(0, 0);
+		float heading = 0;
+		nextPathCalls = 0;
+		while (MapPath *mp = map.nextPath(pos, 0, heading, types)) {
+			nextPathCalls++;
+			mp->drawn = true;
+			const bool reversed = mp->segment.start.distance(pos) > mp->segment.end.distance(pos);
+			const ofVec2f start = reversed ? mp->segment.end : mp->segment.start;
+			pos = reversed ? mp->segment.start : mp->segment.end;
+			heading = atan2(pos.x - start.x, pos.y - start.y) * 180 / 3.14159;
+		}
+	});
+
+	static const int kCounterCalls = 100;
+	volatile int sink = 0;
+	const double countersMs = bestOfMs(map, path, false, [&]() {
+		for (int i = 0; i < kCounterCalls; ++i) {
+			sink = sink + map.getPathCount() + map.getActivePathCount() + map.getDrawnPaths();
+		}
+	});
+
+	char line[1024];
+	sprintf(line, "{\"benchmark\":\"map\",\"generator\":\"%s\",\"size\":%d,\"segments\":%d,\"simplified_segments\":%d,\"optimized_segments\":%d,"
+			"\"load_ms\":%.3f,\"rescale_ms\":%.3f,\"simplify_ms\":%.3f,\"optimize_ms\":%.3f,"
+			"\"next_path_job_ms\":%.3f,\"next_path_calls\":%d,\"next_path_us\":%.3f,\"counters_us\":%.3f}",
+			generator.c_str(), size, segments, simplifiedSegments, optimizedSegments,
+			loadMs, rescaleMs, simplifyMs, optimizeMs,
+			nextPathMs, nextPathCalls, nextPathCalls > 0 ? nextPathMs * 1000.0 / nextPathCalls : 0.0,
+			countersMs * 1000.0 / kCounterCalls);
+
+	cout << line << endl;
+	out << line << endl;
+}
+
+int runMapBenchmark(const string &outputPath) {
+	ofstream out(outputPath.c_str(), ios::app);
+	if (!out) {
+		cout << "Couldn't open " << outputPath << endl;
+		return 1;
+	}
+
+	MapGenerator generator;
+	const string dir = ofToDataPath("bench-maps", true);
+	ofDirectory::createDirectory(dir, false, true);
+
+	const int gridSizes[] = { 10, 30, 60 };
+	for (int size : gridSizes) {
+		const string path = dir + "/grid-" + ofToString(size) + ".svg";
+		MapGenerator::write(path, generator.streetGrid(size, size, 4));
+		benchmarkMap("grid", size, path, out);
+	}
+
+	const int lineCounts[] = { 1000, 5000, 20000 };
+	for (int size : lineCounts) {
+		const string path = dir + "/random-" + ofToString(size) + ".svg";
+		MapGenerator::write(path, generator.randomLines(size, 4));
+		benchmarkMap("random", size, path, out);
+	}
+
+	return 0;
+}
+
+static string jobRobotJson(Robot &r, const SimRobot &sim) {
+	static const RobotState states[] = { R_NO_CONN, R_START, R_CALIBRATING_ANGLE, R_ROTATING_TO_ANGLE, R_WAITING_ANGLE,
+		R_READY_TO_POSITION, R_POSITIONING, R_WAIT_AFTER_POSITION, R_READY_TO_DRAW, R_DRAWING, R_DONE_DRAWING, R_STOPPED };
+
+	stringstream json;
+	json << "{\"id\":" << r.id << ",\"segments\":" << r.segmentsDrawn
+		<< ",\"pen_down_m\":" << sim.penDownDistance << ",\"pen_up_m\":" << sim.penUpDistance
+		<< ",\"idle_s\":" << r.timeInState(R_READY_TO_POSITION) + r.timeInState(R_STOPPED)
+		<< ",\"state_s\":{";
+	for (int i = 0; i < sizeof(states) / sizeof(states[0]); ++i) {
+		json << (i ? "," : "") << "\"" << Robot::stateString(states[i]) << "\":" << r.timeInState(states[i]);
+	}
+	json << "}}";
+	return json.str();
+}
+
+// Reaches into ofApp for the map, robots and safety counters.
+class JobBenchmark {
+public:
+	static string run(const string &mapPath, int numRobots);
+};
+
+string JobBenchmark::run(const string &mapPath, int numRobots) {
+	SimClock clock;
+	Simulator sim(defaultSimConfig());
+
+	ofApp app;
+	app.setupHeadless(&clock, &clock, &sim);
+
+	// Spread robots around a circle, clear of each other's safety zone.
+	for (int i = 0; i < numRobots; ++i) {
+		const float angle = TWO_PI * i / numRobots;
+		const ofVec2f pos = ofVec2f(cos(angle), sin(angle)) * 0.35;
+
+		Robot *r = new Robot(i + 1, 100 + i, "sim" + ofToString(i + 1), &clock);
+		r->logging = false;
+		r->simulator = &sim;
+		app.addRobot(r);
+		sim.addRobot(r->id, r->markerId, pos, 0);
+	}
+
+	app.loadMap(mapPath);
+	app.setState(MR_RUNNING);
+
+	const int total = app.currentMap->getActivePathCount();
+	int drawn = 0;
+	float lastProgressTime = 0;
+	bool finished = false;
+
+	while (clock.now() < kJobMaxSec) {
+		app.stepSimulation(kJobTickSec);
+		app.commandRobots();
+
+		const int nowDrawn = app.currentMap->getDrawnPaths();
+		if (nowDrawn != drawn) {
+			drawn = nowDrawn;
+			lastProgressTime = clock.now();
+		}
+		if (drawn >= total) {
+			finished = true;
+			break;
+		}
+		if (clock.now() - lastProgressTime > kJobStallSec) {
+			break;
+		}
+	}
+
+	float penDown = 0, penUp = 0;
+	stringstream robots;
+	for (auto &p : app.robotsById) {
+		const SimRobot &simRobot = sim.robots[p.first];
+		penDown += simRobot.penDownDistance;
+		penUp += simRobot.penUpDistance;
+		robots << (robots.tellp() > 0 ? "," : "") << jobRobotJson(*p.second, simRobot);
+	}
+
+	stringstream json;
+	json << "{\"benchmark\":\"job\",\"map\":\"" << ofFilePath::getFileName(mapPath) << "\",\"robots\":" << numRobots
+		<< ",\"finished\":" << (finished ? "true" : "false") << ",\"makespan_s\":" << (finished ? clock.now() : lastProgressTime)
+		<< ",\"segments\":" << total << ",\"segments_drawn\":" << drawn
+		<< ",\"pen_down_m\":" << penDown << ",\"pen_up_m\":" << penUp
+		<< ",\"safety_retreats\":" << app.safetyRetreats << ",\"safety_stops\":" << app.safetyStops
+		<< ",\"safety_yields\":" << app.safetyYields << ",\"reservation_deferrals\":" << app.reservationDeferrals
+		<< ",\"load_steals\":" << app.balancer.steals
+		<< ",\"continued_segments\":" << app.fastPathCount
+		<< ",\"per_robot\":[" << robots.str() << "]}";
+
+	for (auto &p : app.robotsById) {
+		delete p.second;
+	}
+	return json.str();
+}
+
+int runJobBenchmark(const string &mapPath, int minRobots, int maxRobots) {
+	string path = mapPath;
+	if (path.empty()) {
+		const string dir = ofToDataPath("bench-maps", true);
+		ofDirectory::createDirectory(dir, false, true);
+		path = dir + "/job-grid.svg";
+		MapGenerator generator;
+		MapGenerator::write(path, generator.streetGrid(8, 8, 4));
+	}
+
+	for (int n = minRobots; n <= maxRobots; ++n) {
+		// The coordinator is chatty, keep stdout for results.
+		ofstream discard;
+		streambuf *coutBuf = cout.rdbuf(discard.rdbuf());
+		const string result = JobBenchmark::run(path, n);
+		cout.rdbuf(coutBuf);
+
+		cout << result << endl;
+	}
+
+	return 0;
+}
+
+// Reaches into ofApp for the map.
+class ReplayBenchmark {
+public:
+	static int run(const string &logPath);
+};
+
+int ReplayBenchmark::run(const string &logPath) {
+	ReplayClock clock;
+	ofApp app;
+	app.replayPath = logPath;
+	app.replayFast = true;
+	app.setupHeadless(&clock, NULL, NULL);
+
+	ofstream discard;
+	streambuf *coutBuf = cout.rdbuf(discard.rdbuf());
+
+	if (!app.startReplay(logPath, &clock)) {
+		cout.rdbuf(coutBuf);
+		cout << "Couldn't replay " << logPath << endl;
+		return 1;
+	}
+
+	vector<double> frameUs;
+	const uint64_t start = ofGetElapsedTimeMicros();
+	while (true) {
+		const uint64_t frameStart = ofGetElapsedTimeMicros();
+		if (!app.replayFrame()) {
+			break;
+		}
+		frameUs.push_back(ofGetElapsedTimeMicros() - frameStart);
+	}
+	const double wallSec = (ofGetElapsedTimeMicros() - start) / 1e6;
+
+	cout.rdbuf(coutBuf);
+
+	const BenchmarkStats stats = benchmarkStats(frameUs);
+	printf("{\"benchmark\":\"replay\",\"log\":\"%s\",\"records\":%d,\"frames\":%d,\"recorded_s\":%.3f,\"wall_s\":%.3f,"
+		   "\"frame_mean_us\":%.3f,\"frame_p50_us\":%.3f,\"frame_p99_us\":%.3f,\"frame_max_us\":%.3f,\"segments_drawn\":%d}\n",
+		   ofFilePath::getFileName(logPath).c_str(), app.replayer->records, (int)frameUs.size(), clock.now(), wallSec,
+		   stats.mean, stats.p50, stats.p99, stats.max, app.currentMap->getDrawnPaths());
+
+	for (auto &p : app.robotsById) {
+		delete p.second;
+	}
+	return 0;
+}
+
+int runReplayBenchmark(const string &logPath) {
+	return ReplayBenchmark::run(logPath);
+}
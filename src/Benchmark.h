@@ -0,0 +1,40 @@
+//
+//  Benchmark.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef Benchmark_h
+#define Benchmark_h
+
+#include "ofMain.h"
+
+// Headless benchmarks, each prints one JSON object per line to stdout so
+// results can be collected and compared between versions.
+
+// Cost of one control step with the MPC line follower vs the 5ms loop budget.
+int runControllerBenchmark(int iterations);
+
+// Load, rescale, optimise and plan a full job over synthetic maps of
+// increasing size. Results go to stdout and are appended to outputPath.
+int runMapBenchmark(const string &outputPath);
+
+// Draw a whole map with N simulated robots through the real coordinator
+// logic, for every N in [minRobots, maxRobots]. Generates a street grid
+// when mapPath is empty.
+int runJobBenchmark(const string &mapPath, int minRobots, int maxRobots);
+
+// Replay a recorded input log as fast as possible and time each coordinator
+// frame. The drawn segment count should not change between versions.
+int runReplayBenchmark(const string &logPath);
+
+// Summary statistics over a set of samples, in the samples' unit.
+typedef struct BenchmarkStats {
+	double mean, p50, p99, max;
+} BenchmarkStats;
+
+BenchmarkStats benchmarkStats(vector<double> samples);
+
+#endif /* Benchmark_h */
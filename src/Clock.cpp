@@ -0,0 +1,61 @@
+//
+//  Clock.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "Clock.h"
+
+Clock *Clock::real() {
+	static RealClock clock;
+	return &clock;
+}
+
+float RealClock::now() {
+	return ofGetElapsedTimef();
+}
+
+uint64_t RealClock::frameNum() {
+	return ofGetFrameNum();
+}
+
+SimClock::SimClock() :
+	time(0),
+	frame(0)
+{}
+
+float SimClock::now() {
+	return time;
+}
+
+uint64_t SimClock::frameNum() {
+	return frame;
+}
+
+void SimClock::advance(float dt) {
+	time += dt;
+	frame++;
+}
+
+ReplayClock::ReplayClock() :
+	time(0),
+	frame(0)
+{}
+
+float ReplayClock::now() {
+	return time;
+}
+
+uint64_t ReplayClock::frameNum() {
+	return frame;
+}
+
+void ReplayClock::seek(float t) {
+	time = max(time, t);
+}
+
+void ReplayClock::tick() {
+	frame++;
+}
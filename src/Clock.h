@@ -0,0 +1,63 @@
+//
+//  Clock.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef Clock_h
+#define Clock_h
+
+#include "ofMain.h"
+
+// Source of time for timeouts, state timers and send throttling. Robots,
+// markers and the app all take one so they can run off wall time, a
+// simulation or a recording.
+class Clock {
+public:
+	virtual ~Clock() {}
+
+	// Seconds since the clock started
+	virtual float now() = 0;
+	// Control loop iterations so far
+	virtual uint64_t frameNum() = 0;
+
+	// Shared wall clock backed by openFrameworks
+	static Clock *real();
+};
+
+class RealClock : public Clock {
+public:
+	float now();
+	uint64_t frameNum();
+};
+
+// Only moves when advanced, one frame per advance.
+class SimClock : public Clock {
+public:
+	SimClock();
+
+	float now();
+	uint64_t frameNum();
+	void advance(float dt);
+
+	float time;
+	uint64_t frame;
+};
+
+// Follows the timestamps of a recording. Time never runs backwards.
+class ReplayClock : public Clock {
+public:
+	ReplayClock();
+
+	float now();
+	uint64_t frameNum();
+	void seek(float t);
+	void tick();
+
+	float time;
+	uint64_t frame;
+};
+
+#endif /* Clock_h */
@@ -0,0 +1,152 @@
+//
+//  CollinearDedupe.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "CollinearDedupe.h"
+
+#include <unordered_map>
+
+// Angles are binned so the ends of a line this long stray at most
+// toleranceM from the line of the bin
+static const float kLongLineM = 0.5f;
+// Offsets are binned finer than toleranceM, so looking through the bins
+// within it strays little past it
+static const int kOffsetBinsPerTolerance = 4;
+
+static uint64_t binKey(int angleBin, long offsetBin) {
+	return ((uint64_t)angleBin << 40) ^ ((uint64_t)offsetBin & ((1ull << 40) - 1));
+}
+
+// Parts of [a, b] outside every interval of covered
+static void uncovered(const map<float, float> &covered, float a, float b, vector<pair<float, float>> &out) {
+	auto it = covered.upper_bound(a);
+	if (it != covered.begin()) {
+		a = max(a, prev(it)->second);
+	}
+	for (; a < b && it != covered.end() && it->first < b; ++it) {
+		if (it->first > a) {
+			out.push_back(make_pair(a, it->first));
+		}
+		a = max(a, it->second);
+	}
+	if (a < b) {
+		out.push_back(make_pair(a, b));
+	}
+}
+
+static void cover(map<float, float> &covered, float a, float b) {
+	auto it = covered.upper_bound(a);
+	if (it != covered.begin() && prev(it)->second >= a) {
+		--it;
+		a = it->first;
+	}
+	while (it != covered.end() && it->first <= b) {
+		b = max(b, it->second);
+		it = covered.erase(it);
+	}
+	covered[a] = b;
+}
+
+DedupeStats dedupeCollinear(const SegmentBatch &batch, int fixed, float toleranceM, vector<SegmentPiece> &pieces) {
+	DedupeStats stats = { 0, 0, 0 };
+	pieces.clear();
+
+	// An even number of bins puts both axes in the middle of one
+	const int angleBins = 2 * max(1, (int)lround(M_PI / 2 / (toleranceM / kLongLineM)));
+	const float angleStep = M_PI / angleBins;
+	const float offsetStep = toleranceM / kOffsetBinsPerTolerance;
+
+	// What's kept on each line, along its bin's direction
+	unordered_map<uint64_t, map<float, float>> lines;
+	vector<pair<float, float>> parts, left, found;
+	for (int i = 0; i < batch.size(); ++i) {
+		const ofVec2f start = batch.start(i), end = batch.end(i);
+		const float length = start.distance(end);
+		if (length == 0) {
+			if (i >= fixed) {
+				pieces.push_back({ i, start, end });
+			}
+			continue;
+		}
+
+		float angle = atan2(end.y - start.y, end.x - start.x);
+		if (angle < 0) angle += M_PI;
+		int angleBin = lround(angle / angleStep);
+		if (angleBin >= angleBins) angleBin -= angleBins;
+
+		// Parts of the segment, from 0 at start to 1 at end, that no line
+		// in this bin or the ones next to it covers
+		parts.assign(1, make_pair(0.f, 1.f));
+		for (int step = -1; step <= 1 && i >= fixed && !parts.empty(); ++step) {
+			const int bin = (angleBin + step + angleBins) % angleBins;
+			const ofVec2f dir(cos(bin * angleStep), sin(bin * angleStep));
+			const ofVec2f normal(-dir.y, dir.x);
+			const long offsetBin = lround(normal.dot((start + end) / 2) / offsetStep);
+			const float t0 = dir.dot(start), t1 = dir.dot(end);
+			for (long o = offsetBin - kOffsetBinsPerTolerance; o <= offsetBin + kOffsetBinsPerTolerance && !parts.empty(); ++o) {
+				auto line = lines.find(binKey(bin, o));
+				if (line == lines.end()) continue;
+
+				left.clear();
+				for (auto &part : parts) {
+					const float a = t0 + (t1 - t0) * part.first, b = t0 + (t1 - t0) * part.second;
+					found.clear();
+					uncovered(line->second, min(a, b), max(a, b), found);
+					for (auto &f : found) {
+						const float s0 = (f.first - t0) / (t1 - t0), s1 = (f.second - t0) / (t1 - t0);
+						const float from = max(part.first, min(s0, s1)), to = min(part.second, max(s0, s1));
+						if (from < to) left.push_back(make_pair(from, to));
+					}
+				}
+				sort(left.begin(), left.end());
+				swap(parts, left);
+			}
+		}
+
+		// Ends touching to within rounding don't count
+		float uncut = 0;
+		for (auto &part : parts) {
+			uncut += part.second - part.first;
+		}
+		if (i < fixed || (uncut > 0 && (1 - uncut) * length < toleranceM)) {
+			parts.assign(1, make_pair(0.f, 1.f));
+		} else {
+			// Slivers left by rounding aren't worth a pen stroke
+			parts.erase(remove_if(parts.begin(), parts.end(), [&](const pair<float, float> &part) {
+				return (part.second - part.first) * length < toleranceM;
+			}), parts.end());
+		}
+
+		const ofVec2f dir(cos(angleBin * angleStep), sin(angleBin * angleStep));
+		const ofVec2f normal(-dir.y, dir.x);
+		map<float, float> &covered = lines[binKey(angleBin, lround(normal.dot((start + end) / 2) / offsetStep))];
+		const float t0 = dir.dot(start), t1 = dir.dot(end);
+		for (auto &part : parts) {
+			const float a = t0 + (t1 - t0) * part.first, b = t0 + (t1 - t0) * part.second;
+			cover(covered, min(a, b), max(a, b));
+		}
+		if (i < fixed) {
+			continue;
+		}
+
+		if (parts.size() == 1 && parts[0].first == 0 && parts[0].second == 1) {
+			pieces.push_back({ i, start, end });
+			continue;
+		}
+		for (auto &part : parts) {
+			pieces.push_back({ i, start + (end - start) * part.first, start + (end - start) * part.second });
+		}
+		if (parts.empty()) {
+			stats.removed++;
+		} else if (parts.size() == 1) {
+			stats.trimmed++;
+		} else {
+			stats.split++;
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,34 @@
+//
+//  CollinearDedupe.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef CollinearDedupe_h
+#define CollinearDedupe_h
+
+#include "ofMain.h"
+#include "SegmentClip.h"
+
+// What's left of segment source, the same way round
+typedef struct SegmentPiece {
+	int source;
+	ofVec2f start, end;
+} SegmentPiece;
+
+typedef struct DedupeStats {
+	// Segments entirely covered, cut short, and cut into several pieces
+	int removed, trimmed, split;
+} DedupeStats;
+
+// Groups segments by the line they lie on, to within toleranceM, and keeps
+// only what no earlier segment on the line covers, so shared edges are
+// drawn once. Lines are binned by angle and offset, and each segment is
+// checked against its neighbouring bins too, so lines on a bin boundary
+// still meet. The first fixed segments are never cut and have no pieces,
+// they only cover later ones. O(n log n).
+DedupeStats dedupeCollinear(const SegmentBatch &batch, int fixed, float toleranceM, vector<SegmentPiece> &pieces);
+
+#endif /* CollinearDedupe_h */
@@ -0,0 +1,169 @@
+//
+//  CollisionAvoidance.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "CollisionAvoidance.h"
+
+// Slowest a robot with right of way is slowed to, so it still clears the pair
+static const float kMinPriorityScale = 0.25f;
+
+// cos of the half angle of the cone a robot counts as driving into
+static const float kApproachCos = 0.5f;
+
+static int64_t cellKey(int cx, int cy) {
+	return ((int64_t)cx << 32) ^ (uint32_t)cy;
+}
+
+static float pointToSegment(const ofVec2f &p, const ofVec2f &a, const ofVec2f &b) {
+	const ofVec2f ab = b - a;
+	const float t = ofClamp((p - a).dot(ab) / max(ab.lengthSquared(), 1e-9f), 0, 1);
+	return p.distance(a + ab * t);
+}
+
+CollisionAvoidance::CollisionAvoidance() :
+	pairsChecked(0)
+{
+	configure(0.18, 0.25, 1.5, 0.25);
+}
+
+void CollisionAvoidance::configure(float inner, float outer, float horizon, float maxSpeed) {
+	innerDiameter = inner;
+	outerDiameter = outer;
+	horizonSec = horizon;
+
+	// Two robots closing at full speed for the whole horizon are still
+	// within one cell of each other
+	cellSize = outerDiameter + 2 * maxSpeed * horizonSec;
+}
+
+float CollisionAvoidance::timeToCollision(const ofVec2f &p, const ofVec2f &v, float diameter) {
+	const float c = p.dot(p) - diameter * diameter;
+	if (c <= 0) {
+		return 0;
+	}
+
+	const float a = v.dot(v);
+	const float b = 2 * p.dot(v);
+	if (a < 1e-9 || b >= 0) {
+		// Not moving relative to each other, or moving apart
+		return INFINITY;
+	}
+
+	const float disc = b * b - 4 * a * c;
+	if (disc < 0) {
+		return INFINITY;
+	}
+	return (-b - sqrt(disc)) / (2 * a);
+}
+
+const map<int, CollisionResult> &CollisionAvoidance::update(const vector<CollisionAgent> &agents) {
+	results.clear();
+	pairsChecked = 0;
+
+	for (auto &bucket : grid) {
+		bucket.second.clear();
+	}
+	for (int i = 0; i < agents.size(); ++i) {
+		const CollisionAgent &a = agents[i];
+		results[a.id] = { 1.0f, false, -1 };
+		grid[cellKey(floor(a.pos.x / cellSize), floor(a.pos.y / cellSize))].push_back(i);
+	}
+
+	for (int i = 0; i < agents.size(); ++i) {
+		const CollisionAgent &a = agents[i];
+		const int cx = floor(a.pos.x / cellSize);
+		const int cy = floor(a.pos.y / cellSize);
+
+		for (int dx = -1; dx <= 1; ++dx) {
+			for (int dy = -1; dy <= 1; ++dy) {
+				auto bucket = grid.find(cellKey(cx + dx, cy + dy));
+				if (bucket == grid.end()) continue;
+
+				for (int j : bucket->second) {
+					// Each unordered pair once
+					if (j <= i) continue;
+					checkPair(a, agents[j]);
+				}
+			}
+		}
+	}
+
+	return results;
+}
+
+// Whether a is heading for b: b lies within a cone around the direction
+// a is driving in
+bool CollisionAvoidance::pathBlocked(const CollisionAgent &a, const CollisionAgent &b) {
+	if (!a.moving) {
+		return false;
+	}
+
+	const ofVec2f heading = (a.target - a.pos).getNormalized();
+	const ofVec2f toOther = (b.pos - a.pos).getNormalized();
+	return heading.dot(toOther) > kApproachCos;
+}
+
+// Whether a is backing off and its target takes it further from b
+bool CollisionAvoidance::separates(const CollisionAgent &a, const CollisionAgent &b) {
+	return a.separating && a.moving && (a.target - a.pos).dot(b.pos - a.pos) < 0;
+}
+
+void CollisionAvoidance::checkPair(const CollisionAgent &a, const CollisionAgent &b) {
+	pairsChecked++;
+
+	const ofVec2f rel = b.pos - a.pos;
+	const float dist = rel.length();
+
+	// Way too close, whichever way they're heading both stop until one is
+	// told to back off
+	if (dist < innerDiameter) {
+		results[a.id].inDanger = true;
+		results[b.id].inDanger = true;
+		limit(a.id, separates(a, b) ? kMinPriorityScale : 0, b.id);
+		limit(b.id, separates(b, a) ? kMinPriorityScale : 0, a.id);
+	}
+
+	// Only a robot driving into the other one has to give way
+	const bool aApproaching = pathBlocked(a, b);
+	const bool bApproaching = pathBlocked(b, a);
+	if (!aApproaching && !bApproaching) {
+		return;
+	}
+
+	const float ttc = timeToCollision(rel, b.vel - a.vel, outerDiameter);
+	if (dist >= outerDiameter && ttc > horizonSec) {
+		return;
+	}
+
+	// How much room is left before the outer zone, as a speed factor
+	const float room = dist < outerDiameter ? 0 : ofClamp(ttc / horizonSec, 0, 1);
+
+	if (aApproaching && bApproaching) {
+		const bool aYields = a.priority < b.priority || (a.priority == b.priority && a.id > b.id);
+		const CollisionAgent &yielder = aYields ? a : b;
+		const CollisionAgent &other = aYields ? b : a;
+
+		limit(yielder.id, 0, other.id);
+		limit(other.id, dist < innerDiameter ? 0 : max(room, kMinPriorityScale), -1);
+	} else {
+		const CollisionAgent &mover = aApproaching ? a : b;
+		const CollisionAgent &other = aApproaching ? b : a;
+
+		// A robot standing clear of the rest of the path is passed slowly,
+		// it may have nowhere better to go
+		const bool passes = !other.moving && pointToSegment(other.pos, mover.pos, mover.target) >= innerDiameter;
+		limit(mover.id, passes ? max(room, kMinPriorityScale) : room, other.id);
+	}
+}
+
+void CollisionAvoidance::limit(int id, float scale, int yieldingTo) {
+	CollisionResult &r = results[id];
+	if (scale < r.speedScale) {
+		r.speedScale = scale;
+		r.yieldingTo = yieldingTo;
+	}
+}
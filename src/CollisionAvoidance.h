@@ -0,0 +1,72 @@
+//
+//  CollisionAvoidance.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef CollisionAvoidance_h
+#define CollisionAvoidance_h
+
+#include "ofMain.h"
+
+#include <unordered_map>
+
+typedef struct CollisionAgent {
+	int id;
+	ofVec2f pos, vel;
+	// Where the robot is driving to in a straight line
+	bool moving;
+	ofVec2f target;
+	// Of two robots in each other's way the lower priority one yields
+	int priority;
+	// Told to back off from a robot it got too close to, so it may leave
+	// the inner safety diameter as long as it drives away
+	bool separating;
+} CollisionAgent;
+
+typedef struct CollisionResult {
+	// 1 is full speed, 0 holds position without leaving the current state
+	float speedScale;
+	// Inside the inner safety diameter of another robot
+	bool inDanger;
+	// Robot this one is giving way to, -1 if none
+	int yieldingTo;
+} CollisionResult;
+
+// Broad phase on a uniform grid, so only nearby pairs are checked and each
+// pair once, then time-to-collision from the estimated velocities. Robots
+// slow or yield before they get inside the outer safety diameter, and both
+// stop inside the inner one.
+class CollisionAvoidance {
+public:
+	CollisionAvoidance();
+
+	// Diameters in m, horizon in s, maxSpeed in m/s sizes the grid cells
+	void configure(float innerDiameter, float outerDiameter, float horizonSec, float maxSpeed);
+
+	// One result per agent, by id
+	const map<int, CollisionResult> &update(const vector<CollisionAgent> &agents);
+
+	// Seconds until two discs of the given diameter touch, 0 if they
+	// already overlap, infinity if they never will at these velocities.
+	static float timeToCollision(const ofVec2f &relPos, const ofVec2f &relVel, float diameter);
+
+	float innerDiameter, outerDiameter, horizonSec;
+	float cellSize;
+
+	// Narrow phase checks in the last update
+	int pairsChecked;
+
+private:
+	bool pathBlocked(const CollisionAgent &a, const CollisionAgent &b);
+	bool separates(const CollisionAgent &a, const CollisionAgent &b);
+	void checkPair(const CollisionAgent &a, const CollisionAgent &b);
+	void limit(int id, float scale, int yieldingTo);
+
+	unordered_map<int64_t, vector<int>> grid;
+	map<int, CollisionResult> results;
+};
+
+#endif /* CollisionAvoidance_h */
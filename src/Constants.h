@@ -11,4 +11,13 @@
 
 #define SIMULATING 0
 
+// Log every coordinator input to data/recordings for replay
+#define RECORD_INPUTS 0
+
+// Journal drawn segments to data/journal so a restarted job carries on
+#define JOURNAL_PROGRESS 1
+
+// Stage timers and latency histograms, see Profiler.h
+#define PROFILING 1
+
 #endif /* Constants_h */
@@ -0,0 +1,71 @@
+//
+//  FleetConfig.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "FleetConfig.h"
+
+static const int kDefaultRobotPort = 5111;
+
+bool parseFleet(const ofxJSONElement &json, vector<RobotConfig> &robots) {
+	if (!json.isObject() || !json["robots"].isArray()) {
+		cout << "Fleet config needs a \"robots\" array" << endl;
+		return false;
+	}
+
+	set<int> ids, markers;
+	const Json::Value &list = json["robots"];
+	for (int i = 0; i < list.size(); ++i) {
+		const Json::Value &entry = list[i];
+		if (!entry.isObject() || !entry["id"].isInt() || !entry["marker"].isInt()) {
+			cout << "Fleet config: robot " << i << " needs an id and a marker" << endl;
+			continue;
+		}
+
+		RobotConfig c;
+		c.id = entry["id"].asInt();
+		c.markerId = entry["marker"].asInt();
+		c.name = entry.get("name", "Robot " + ofToString(c.id)).asString();
+		c.ip = entry.get("ip", "").asString();
+		c.port = entry.get("port", kDefaultRobotPort).asInt();
+
+		if (ids.count(c.id) || markers.count(c.markerId)) {
+			cout << "Fleet config: skipping " << c.name << ", id " << c.id << " or marker " << c.markerId << " is taken" << endl;
+			continue;
+		}
+		ids.insert(c.id);
+		markers.insert(c.markerId);
+		robots.push_back(c);
+	}
+	return true;
+}
+
+bool parseStagingPoints(const ofxJSONElement &json, vector<ofVec2f> &points) {
+	if (!json.isMember("staging")) {
+		return true;
+	}
+	if (!json["staging"].isArray()) {
+		cout << "Fleet config: \"staging\" needs to be an array of [x, y]" << endl;
+		return false;
+	}
+
+	const Json::Value &list = json["staging"];
+	vector<ofVec2f> parsed;
+	for (int i = 0; i < list.size(); ++i) {
+		const Json::Value &entry = list[i];
+		if (!entry.isArray() || entry.size() != 2 || !entry[0].isNumeric() || !entry[1].isNumeric()) {
+			cout << "Fleet config: staging point " << i << " needs to be [x, y]" << endl;
+			continue;
+		}
+		parsed.push_back(ofVec2f(entry[0].asFloat(), entry[1].asFloat()));
+	}
+
+	if (parsed.empty() && !points.empty()) {
+		cout << "Fleet config: no staging points, robots park at the default ones" << endl;
+	}
+	points = parsed;
+	return true;
+}
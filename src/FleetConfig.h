@@ -0,0 +1,33 @@
+//
+//  FleetConfig.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef FleetConfig_h
+#define FleetConfig_h
+
+#include "ofMain.h"
+#include "ofxJSON.h"
+
+typedef struct RobotConfig {
+	int id, markerId;
+	string name;
+
+	// Empty for robots that only exist in the simulator
+	string ip;
+	int port;
+} RobotConfig;
+
+// Reads {"robots": [{"id": 1, "marker": 23, "name": "Delmar",
+// "ip": "192.168.7.74", "port": 5111}, ...]}. Robots without an id or
+// marker, or reusing one, are skipped with a warning.
+bool parseFleet(const ofxJSONElement &json, vector<RobotConfig> &robots);
+
+// Reads the optional "staging": [[x, y], ...] of a fleet config, in m on
+// the canvas, replacing points. Without one points is left as it was.
+bool parseStagingPoints(const ofxJSONElement &json, vector<ofVec2f> &points);
+
+#endif /* FleetConfig_h */
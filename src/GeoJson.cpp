@@ -0,0 +1,404 @@
+//
+//  GeoJson.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "GeoJson.h"
+
+static const size_t kReadChunk = 1 << 16;
+// Web Mercator's sphere, and the latitude where it turns square
+static const double kEarthRadiusM = 6378137.0;
+static const double kMaxLatitude = 85.0511287798;
+// Deeper than any geometry, stops runaway recursion on bad input
+static const int kMaxDepth = 64;
+
+typedef struct GeoObject {
+	string type;
+	vector<vector<ofVec2f>> lines;
+	string pathType;
+} GeoObject;
+
+static bool hasLines(const string &type) {
+	return type == "LineString" || type == "MultiLineString" || type == "Polygon" || type == "MultiPolygon"
+		|| type == "GeometryCollection" || type == "Feature";
+}
+
+class GeoJsonParser {
+public:
+	GeoJsonParser(FILE *file, GeoJsonReader &reader, const function<void(const string&, const vector<ofVec2f>&)> &onLine) :
+		file(file), reader(reader), onLine(onLine),
+		len(0), pos(0), offset(0),
+		hasOrigin(false), error(false)
+	{}
+
+	bool parseDocument() {
+		GeoObject top;
+		if (!parseObject(top, 0)) {
+			return false;
+		}
+		// A lone feature or geometry rather than a collection
+		if (top.type != "FeatureCollection") {
+			emit(top);
+		}
+		skipSpace();
+		return peek() == EOF || fail("trailing data");
+	}
+
+private:
+	int peek() {
+		if (pos == len) {
+			offset += len;
+			len = fread(buf, 1, kReadChunk, file);
+			pos = 0;
+			if (len == 0) return EOF;
+		}
+		return (unsigned char)buf[pos];
+	}
+
+	int next() {
+		const int c = peek();
+		if (c != EOF) pos++;
+		return c;
+	}
+
+	void skipSpace() {
+		while (isspace(peek())) pos++;
+	}
+
+	bool fail(const string &what) {
+		if (!error) {
+			cout << "GeoJSON: " << what << " at byte " << offset + pos << endl;
+		}
+		error = true;
+		return false;
+	}
+
+	bool expect(char c) {
+		skipSpace();
+		if (next() != c) {
+			return fail(string("expected '") + c + "'");
+		}
+		return true;
+	}
+
+	bool parseString(string &out) {
+		out.clear();
+		if (!expect('"')) return false;
+
+		while (true) {
+			int c = next();
+			if (c == EOF) return fail("unterminated string");
+			if (c == '"') return true;
+			if (c != '\\') {
+				out += (char)c;
+				continue;
+			}
+
+			c = next();
+			switch (c) {
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u': {
+					char hex[5] = { 0 };
+					for (int i = 0; i < 4; ++i) {
+						const int h = next();
+						if (!isxdigit(h)) return fail("bad \\u escape");
+						hex[i] = h;
+					}
+					// Enough for type names, surrogate pairs come out as two
+					const unsigned int u = strtoul(hex, NULL, 16);
+					if (u < 0x80) {
+						out += (char)u;
+					} else if (u < 0x800) {
+						out += (char)(0xc0 | (u >> 6));
+						out += (char)(0x80 | (u & 0x3f));
+					} else {
+						out += (char)(0xe0 | (u >> 12));
+						out += (char)(0x80 | ((u >> 6) & 0x3f));
+						out += (char)(0x80 | (u & 0x3f));
+					}
+					break;
+				}
+				case EOF: return fail("unterminated string");
+				default: out += (char)c; break;
+			}
+		}
+	}
+
+	// Numbers, true, false and null, as their text
+	bool parseScalar(string &out) {
+		out.clear();
+		skipSpace();
+		int c;
+		while ((c = peek()) != EOF && (isalnum(c) || c == '-' || c == '+' || c == '.')) {
+			out += (char)c;
+			pos++;
+		}
+		return !out.empty() || fail("expected a value");
+	}
+
+	bool parseNumber(double &out) {
+		string text;
+		if (!parseScalar(text)) return false;
+
+		char *end;
+		out = strtod(text.c_str(), &end);
+		return *end == '\0' || fail("bad number " + text);
+	}
+
+	bool skipValue(int depth) {
+		if (depth > kMaxDepth) return fail("nested too deep");
+
+		skipSpace();
+		const int c = peek();
+		string text;
+		if (c == '"') {
+			return parseString(text);
+		} else if (c == '{' || c == '[') {
+			const char close = c == '{' ? '}' : ']';
+			pos++;
+			skipSpace();
+			if (peek() == close) {
+				pos++;
+				return true;
+			}
+			do {
+				if (c == '{' && !(parseString(text) && expect(':'))) return false;
+				if (!skipValue(depth + 1)) return false;
+				skipSpace();
+			} while (peek() == ',' && next());
+			return expect(close);
+		}
+		return parseScalar(text);
+	}
+
+	// Calls each for every element of an array, leaving the cursor on it
+	bool parseArray(const function<bool()> &each) {
+		if (!expect('[')) return false;
+		skipSpace();
+		if (peek() == ']') {
+			pos++;
+			return true;
+		}
+		do {
+			if (!each()) return false;
+			skipSpace();
+		} while (peek() == ',' && next());
+		return expect(']');
+	}
+
+	bool parseObject(GeoObject &obj, int depth) {
+		if (depth > kMaxDepth) return fail("nested too deep");
+		skipSpace();
+		if (peek() == 'n') {
+			// "geometry": null
+			string text;
+			return parseScalar(text);
+		}
+		if (!expect('{')) return false;
+
+		skipSpace();
+		if (peek() == '}') {
+			pos++;
+			return true;
+		}
+
+		string key;
+		do {
+			if (!parseString(key) || !expect(':')) return false;
+
+			bool ok;
+			if (key == "type") {
+				ok = parseString(obj.type);
+			} else if (key == "coordinates") {
+				ofVec2f position;
+				bool isPosition;
+				ok = parseCoordinates(obj.lines, position, isPosition, depth + 1);
+			} else if (key == "geometry") {
+				GeoObject geometry;
+				ok = parseObject(geometry, depth + 1);
+				if (hasLines(geometry.type)) {
+					takeLines(obj, geometry);
+				}
+			} else if (key == "geometries") {
+				ok = parseArray([&]() {
+					GeoObject geometry;
+					const bool parsed = parseObject(geometry, depth + 1);
+					if (hasLines(geometry.type)) {
+						takeLines(obj, geometry);
+					}
+					return parsed;
+				});
+			} else if (key == "features") {
+				ok = parseArray([&]() {
+					GeoObject feature;
+					const bool parsed = parseObject(feature, depth + 1);
+					if (parsed && feature.type == "Feature") {
+						emit(feature);
+					}
+					return parsed;
+				});
+			} else if (key == "properties") {
+				ok = parseProperties(obj, depth + 1);
+			} else {
+				ok = skipValue(depth + 1);
+			}
+			if (!ok) return false;
+			skipSpace();
+		} while (peek() == ',' && next());
+
+		// Points come in the same shape as lines
+		if (!hasLines(obj.type)) {
+			obj.lines.clear();
+		}
+		return expect('}');
+	}
+
+	bool parseProperties(GeoObject &obj, int depth) {
+		skipSpace();
+		if (peek() != '{') {
+			return skipValue(depth);
+		}
+		pos++;
+		skipSpace();
+		if (peek() == '}') {
+			pos++;
+			return true;
+		}
+
+		string key, value;
+		do {
+			if (!parseString(key) || !expect(':')) return false;
+
+			skipSpace();
+			const int c = peek();
+			bool ok;
+			if (key != reader.typeProperty || c == '{' || c == '[') {
+				ok = skipValue(depth + 1);
+			} else if (c == '"') {
+				ok = parseString(obj.pathType);
+			} else {
+				ok = parseScalar(value);
+				if (value != "null" && value != "true" && value != "false") {
+					obj.pathType = value;
+				}
+			}
+			if (!ok) return false;
+			skipSpace();
+		} while (peek() == ',' && next());
+		return expect('}');
+	}
+
+	// A position goes in position, arrays of them onto lines
+	bool parseCoordinates(vector<vector<ofVec2f>> &lines, ofVec2f &position, bool &isPosition, int depth) {
+		if (depth > kMaxDepth) return fail("nested too deep");
+		if (!expect('[')) return false;
+
+		skipSpace();
+		const int c = peek();
+		if (c == '-' || isdigit(c)) {
+			// lon, lat and maybe altitude
+			double v[3];
+			int n = 0;
+			do {
+				double d;
+				if (!parseNumber(d)) return false;
+				if (n < 3) v[n] = d;
+				n++;
+				skipSpace();
+			} while (peek() == ',' && next());
+			if (n < 2) return fail("position needs two numbers");
+
+			position = project(v[0], v[1]);
+			isPosition = true;
+			return expect(']');
+		}
+
+		isPosition = false;
+		vector<ofVec2f> line;
+		if (c == ']') {
+			pos++;
+			return true;
+		}
+		do {
+			ofVec2f p;
+			bool childIsPosition;
+			if (!parseCoordinates(lines, p, childIsPosition, depth + 1)) return false;
+			if (childIsPosition) line.push_back(p);
+			skipSpace();
+		} while (peek() == ',' && next());
+
+		if (!line.empty()) {
+			lines.push_back(line);
+		}
+		return expect(']');
+	}
+
+	ofVec2f project(double lon, double lat) {
+		lat = ofClamp(lat, -kMaxLatitude, kMaxLatitude);
+		const double x = kEarthRadiusM * lon * M_PI / 180;
+		const double y = kEarthRadiusM * log(tan(M_PI / 4 + lat * M_PI / 360));
+		if (!hasOrigin) {
+			originX = x;
+			originY = y;
+			hasOrigin = true;
+		}
+		return ofVec2f(x - originX, originY - y);
+	}
+
+	void takeLines(GeoObject &to, GeoObject &from) {
+		for (auto &line : from.lines) {
+			to.lines.push_back(move(line));
+		}
+		from.lines.clear();
+	}
+
+	void emit(const GeoObject &obj) {
+		reader.features++;
+		for (auto &line : obj.lines) {
+			reader.lines++;
+			onLine(obj.pathType, line);
+		}
+	}
+
+	FILE *file;
+	GeoJsonReader &reader;
+	const function<void(const string&, const vector<ofVec2f>&)> &onLine;
+
+	char buf[kReadChunk];
+	size_t len, pos;
+	// Of buf in the file
+	long offset;
+
+	bool hasOrigin;
+	double originX, originY;
+	bool error;
+};
+
+GeoJsonReader::GeoJsonReader(const string &typeProperty) :
+	typeProperty(typeProperty),
+	features(0), lines(0)
+{}
+
+bool GeoJsonReader::read(const string &path, const function<void(const string &type, const vector<ofVec2f> &line)> &onLine) {
+	features = 0;
+	lines = 0;
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		cout << "Couldn't open " << path << endl;
+		return false;
+	}
+
+	// The read buffer is too big for the stack
+	unique_ptr<GeoJsonParser> parser(new GeoJsonParser(file, *this, onLine));
+	const bool ok = parser->parseDocument();
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,32 @@
+//
+//  GeoJson.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef GeoJson_h
+#define GeoJson_h
+
+#include "ofMain.h"
+
+// Reads GeoJSON a token at a time rather than into a document, so only the
+// feature being read is ever in memory. LineString, MultiLineString,
+// Polygon and MultiPolygon lines come out in Web Mercator meters, y down
+// as in SVG, relative to the first position in the file so floats keep
+// their precision.
+class GeoJsonReader {
+public:
+	// Each feature's typeProperty becomes its lines' type, "" if missing
+	GeoJsonReader(const string &typeProperty);
+
+	// On a syntax error the lines before it have been handed out and false
+	// is returned
+	bool read(const string &path, const function<void(const string &type, const vector<ofVec2f> &line)> &onLine);
+
+	string typeProperty;
+	int features, lines;
+};
+
+#endif /* GeoJson_h */
@@ -0,0 +1,60 @@
+//
+//  HeadingConvergence.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "HeadingConvergence.h"
+
+HeadingConvergence::HeadingConvergence(int windowSize) :
+	samples(windowSize),
+	nextIdx(0),
+	count(0)
+{}
+
+void HeadingConvergence::reset() {
+	nextIdx = 0;
+	count = 0;
+}
+
+void HeadingConvergence::addSample(float deg) {
+	const float rad = ofDegToRad(deg);
+	samples[nextIdx] = ofVec2f(cos(rad), sin(rad));
+	nextIdx = (nextIdx + 1) % samples.size();
+	count = min(count + 1, (int)samples.size());
+}
+
+int HeadingConvergence::numSamples() {
+	return count;
+}
+
+float HeadingConvergence::meanDeg() {
+	ofVec2f sum(0, 0);
+	for (int i = 0; i < count; ++i) {
+		sum += samples[i];
+	}
+	return fmod(ofRadToDeg(atan2(sum.y, sum.x)) + 360.0f, 360.0f);
+}
+
+float HeadingConvergence::stdDevDeg() {
+	if (count == 0) {
+		return INFINITY;
+	}
+
+	ofVec2f sum(0, 0);
+	for (int i = 0; i < count; ++i) {
+		sum += samples[i];
+	}
+
+	const float r = min(1.0f, sum.length() / count);
+	if (r <= 0) {
+		return INFINITY;
+	}
+	return ofRadToDeg(sqrt(-2.0f * log(r)));
+}
+
+bool HeadingConvergence::converged(float maxStdDevDeg) {
+	return count == samples.size() && stdDevDeg() < maxStdDevDeg;
+}
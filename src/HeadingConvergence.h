@@ -0,0 +1,35 @@
+//
+//  HeadingConvergence.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef HeadingConvergence_h
+#define HeadingConvergence_h
+
+#include "ofMain.h"
+
+// Circular mean and spread of the last few heading samples, used to tell
+// when the camera's view of a robot's heading has settled.
+class HeadingConvergence {
+public:
+	HeadingConvergence(int windowSize = 8);
+
+	void reset();
+	void addSample(float deg);
+
+	int numSamples();
+	float meanDeg();
+	float stdDevDeg();
+
+	// Full window whose circular standard deviation is below maxStdDevDeg.
+	bool converged(float maxStdDevDeg);
+
+private:
+	vector<ofVec2f> samples;
+	int nextIdx, count;
+};
+
+#endif /* HeadingConvergence_h */
@@ -0,0 +1,231 @@
+//
+//  InputLog.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "InputLog.h"
+
+static const char kMagic[4] = { 'M', 'R', 'I', 'N' };
+static const uint8_t kVersion = 1;
+
+// Larger records are corrupt, the biggest real input is a camera frame
+static const uint32_t kMaxRecordLength = 1 << 20;
+
+// Hours of camera frames, a run that goes on longer stops recording
+static const uint64_t kMaxLogBytes = 4ULL << 30;
+static const int kFlushIntervalMs = 200;
+
+InputRecorder::InputRecorder() :
+	records(0),
+	file(NULL),
+	lastTime(0),
+	bytes(0),
+	stopping(false)
+{}
+
+InputRecorder::~InputRecorder() {
+	close();
+}
+
+bool InputRecorder::open(const string &p) {
+	close();
+
+	file = fopen(p.c_str(), "wb");
+	if (!file) {
+		cout << "Couldn't open input log " << p << endl;
+		return false;
+	}
+
+	fwrite(kMagic, 1, sizeof(kMagic), file);
+	fwrite(&kVersion, 1, 1, file);
+	fflush(file);
+
+	path = p;
+	records = 0;
+	lastTime = 0;
+	bytes = sizeof(kMagic) + 1;
+	stopping = false;
+	writer = thread(&InputRecorder::writeLoop, this);
+	cout << "Recording inputs to " << path << endl;
+	return true;
+}
+
+void InputRecorder::close() {
+	if (writer.joinable()) {
+		{
+			lock_guard<mutex> lock(bufferLock);
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+	}
+
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+}
+
+bool InputRecorder::isOpen() {
+	return writer.joinable();
+}
+
+void InputRecorder::record(double time, InputType type, const char *data, int length) {
+	if (!writer.joinable()) {
+		return;
+	}
+
+	lastTime = max(lastTime, time);
+	const uint8_t t = type;
+	const uint32_t len = length;
+	const size_t recordBytes = sizeof(lastTime) + 1 + sizeof(len) + len;
+	if (bytes + recordBytes > kMaxLogBytes) {
+		cout << "Input log " << path << " is full after " << records << " records, recording stopped" << endl;
+		close();
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(bufferLock);
+		const size_t at = buffer.size();
+		buffer.resize(at + recordBytes);
+		memcpy(&buffer[at], &lastTime, sizeof(lastTime));
+		memcpy(&buffer[at + sizeof(lastTime)], &t, 1);
+		memcpy(&buffer[at + sizeof(lastTime) + 1], &len, sizeof(len));
+		if (len > 0) {
+			memcpy(&buffer[at + sizeof(lastTime) + 1 + sizeof(len)], data, len);
+		}
+	}
+	bytes += recordBytes;
+	records++;
+}
+
+void InputRecorder::record(double time, InputType type, const string &data) {
+	record(time, type, data.c_str(), data.length());
+}
+
+void InputRecorder::recordFrame(double time, uint64_t frame) {
+	record(time, IN_FRAME, (const char *)&frame, sizeof(frame));
+}
+
+void InputRecorder::writeLoop() {
+	vector<char> batch;
+	bool done = false;
+	while (!done) {
+		{
+			unique_lock<mutex> lock(bufferLock);
+			wake.wait_for(lock, chrono::milliseconds(kFlushIntervalMs), [this]() { return stopping; });
+			batch.swap(buffer);
+			done = stopping;
+		}
+		if (batch.empty()) {
+			continue;
+		}
+
+		// Keep what we have if the app dies mid-run
+		fwrite(batch.data(), 1, batch.size(), file);
+		fflush(file);
+		batch.clear();
+	}
+}
+
+//--------------------------------------------------------------
+
+InputReplayer::InputReplayer() :
+	records(0),
+	file(NULL),
+	hasPending(false)
+{}
+
+InputReplayer::~InputReplayer() {
+	close();
+}
+
+bool InputReplayer::open(const string &p) {
+	close();
+
+	file = fopen(p.c_str(), "rb");
+	if (!file) {
+		cout << "Couldn't open input log " << p << endl;
+		return false;
+	}
+
+	char magic[sizeof(kMagic)];
+	uint8_t version = 0;
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+		fread(&version, 1, 1, file) != 1 || version != kVersion) {
+		cout << "Not an input log: " << p << endl;
+		close();
+		return false;
+	}
+
+	path = p;
+	records = 0;
+	hasPending = readRecord(pending);
+	return true;
+}
+
+void InputReplayer::close() {
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+	hasPending = false;
+}
+
+bool InputReplayer::done() {
+	return !hasPending;
+}
+
+double InputReplayer::nextTime() {
+	return hasPending ? pending.time : 0;
+}
+
+bool InputReplayer::next(InputRecord &record) {
+	if (!hasPending) {
+		return false;
+	}
+
+	record = pending;
+	records++;
+	hasPending = readRecord(pending);
+	return true;
+}
+
+uint64_t InputReplayer::frameNumber(const InputRecord &record) {
+	uint64_t frame = 0;
+	if (record.type == IN_FRAME && record.data.size() == sizeof(frame)) {
+		memcpy(&frame, record.data.data(), sizeof(frame));
+	}
+	return frame;
+}
+
+bool InputReplayer::readRecord(InputRecord &record) {
+	if (!file) {
+		return false;
+	}
+
+	uint8_t type;
+	uint32_t length;
+	if (fread(&record.time, sizeof(record.time), 1, file) != 1 ||
+		fread(&type, 1, 1, file) != 1 ||
+		fread(&length, sizeof(length), 1, file) != 1) {
+		// End of log, or a record cut short by a crash
+		return false;
+	}
+
+	if (type >= N_INPUT_TYPES || length > kMaxRecordLength) {
+		cout << "Corrupt input log record after " << records << " records" << endl;
+		return false;
+	}
+
+	record.type = (InputType)type;
+	record.data.resize(length);
+	if (length > 0 && fread(&record.data[0], 1, length, file) != length) {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,101 @@
+//
+//  InputLog.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef InputLog_h
+#define InputLog_h
+
+#include "ofMain.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Everything that can change what the coordinator does. A log replayed
+// through ofApp with a ReplayClock reproduces the original run.
+typedef enum InputType {
+	IN_FRAME = 0,	// one commandRobots pass, data is the frame number
+	IN_CV,			// OSC /cv json
+	IN_STATE,		// OSC /state json
+	IN_ROBOT,		// UDP datagram from a robot
+	IN_COMMAND,		// GUI or keyboard command, see ofApp::runCommand
+	IN_MAP_LOAD,	// path of the loaded map
+	N_INPUT_TYPES
+} InputType;
+
+typedef struct InputRecord {
+	double time;
+	InputType type;
+	string data;
+} InputRecord;
+
+// Appends records to a binary log:
+//   header: "MRIN" uint8 version
+//   record: double time, uint8 type, uint32 length, length bytes of data
+// The control loop only buffers records; a writer thread writes them out a
+// few times a second. A log stops recording once it reaches its size cap.
+class InputRecorder {
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	bool open(const string &path);
+	// Writes what's buffered
+	void close();
+	bool isOpen();
+
+	// No-op when not open. Times must not run backwards.
+	void record(double time, InputType type, const char *data, int length);
+	void record(double time, InputType type, const string &data);
+	void recordFrame(double time, uint64_t frame);
+
+	string path;
+	int records;
+
+private:
+	void writeLoop();
+
+	FILE *file;
+	double lastTime;
+	// Including what's still buffered
+	uint64_t bytes;
+
+	thread writer;
+	mutex bufferLock;
+	condition_variable wake;
+	vector<char> buffer;
+	bool stopping;
+};
+
+// Reads a log back one record at a time, with one record of lookahead so
+// callers can pace themselves on the next timestamp.
+class InputReplayer {
+public:
+	InputReplayer();
+	~InputReplayer();
+
+	bool open(const string &path);
+	void close();
+
+	bool done();
+	double nextTime();
+	bool next(InputRecord &record);
+
+	static uint64_t frameNumber(const InputRecord &record);
+
+	string path;
+	int records;
+
+private:
+	bool readRecord(InputRecord &record);
+
+	FILE *file;
+	InputRecord pending;
+	bool hasPending;
+};
+
+#endif /* InputLog_h */
@@ -0,0 +1,153 @@
+//
+//  LineMPC.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "LineMPC.h"
+
+static const int kProjectedGradientIters = 20;
+
+LineMPC::LineMPC() :
+	lateralVel(0),
+	lastCommand(0)
+{
+	configure(10, 0.05, 0.1, 1.0, 0.02, 0.05);
+}
+
+void LineMPC::configure(int n, float step, float lag, float qWeight, float rWeight, float rdWeight) {
+	horizon = n;
+	stepSec = step;
+	lagSec = lag;
+	q = qWeight;
+	r = rWeight;
+	rd = rdWeight;
+
+	const double a = min(1.0, (double)stepSec / lagSec);
+
+	// Unit responses of the model: e[k] = phiE[k] . x0 + sum_j gammaE[k][j] u[j]
+	phiE.assign(n * 2, 0);
+	gammaE.assign(n * n, 0);
+	for (int col = -2; col < n; ++col) {
+		// col -2 and -1 are the initial error and velocity, 0..n-1 the commands
+		double e = col == -2 ? 1 : 0;
+		double v = col == -1 ? 1 : 0;
+		for (int k = 0; k < n; ++k) {
+			v += ((k == col ? 1.0 : 0.0) - v) * a;
+			e += stepSec * v;
+			if (col < 0) {
+				phiE[k * 2 + col + 2] = e;
+			} else {
+				gammaE[k * n + col] = e;
+			}
+		}
+	}
+
+	// H = gammaE' q gammaE + r I + rd D'D, with D the first difference of u.
+	H.assign(n * n, 0);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < n; ++j) {
+			double sum = 0;
+			for (int k = 0; k < n; ++k) {
+				sum += gammaE[k * n + i] * q * gammaE[k * n + j];
+			}
+			H[i * n + j] = sum;
+		}
+		H[i * n + i] += r + 2 * rd;
+		if (i + 1 < n) {
+			H[i * n + i + 1] -= rd;
+			H[(i + 1) * n + i] -= rd;
+		}
+	}
+	H[(n - 1) * n + n - 1] -= rd;
+
+	// Cholesky factor for the unconstrained solve
+	L.assign(n * n, 0);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j <= i; ++j) {
+			double sum = H[i * n + j];
+			for (int k = 0; k < j; ++k) {
+				sum -= L[i * n + k] * L[j * n + k];
+			}
+			L[i * n + j] = i == j ? sqrt(max(sum, 1e-12)) : sum / L[j * n + j];
+		}
+	}
+
+	// Gershgorin bound on the largest eigenvalue for the gradient step
+	hNorm = 0;
+	for (int i = 0; i < n; ++i) {
+		double rowSum = 0;
+		for (int j = 0; j < n; ++j) {
+			rowSum += fabs(H[i * n + j]);
+		}
+		hNorm = max(hNorm, rowSum);
+	}
+
+	g.assign(n, 0);
+	u.assign(n, 0);
+	tmp.assign(n, 0);
+}
+
+void LineMPC::reset() {
+	lateralVel = 0;
+	lastCommand = 0;
+}
+
+float LineMPC::solve(float crossTrack, float uMax, float dt) {
+	const int n = horizon;
+
+	// Linear term: gammaE' q (phiE x0) - rd * uPrev on the first command
+	for (int i = 0; i < n; ++i) {
+		double sum = 0;
+		for (int k = 0; k < n; ++k) {
+			const double free = phiE[k * 2 + 0] * crossTrack + phiE[k * 2 + 1] * lateralVel;
+			sum += gammaE[k * n + i] * q * free;
+		}
+		g[i] = sum;
+	}
+	g[0] -= rd * lastCommand;
+
+	// Unconstrained optimum: L L' u = -g
+	for (int i = 0; i < n; ++i) {
+		double sum = -g[i];
+		for (int k = 0; k < i; ++k) {
+			sum -= L[i * n + k] * tmp[k];
+		}
+		tmp[i] = sum / L[i * n + i];
+	}
+	for (int i = n - 1; i >= 0; --i) {
+		double sum = tmp[i];
+		for (int k = i + 1; k < n; ++k) {
+			sum -= L[k * n + i] * u[k];
+		}
+		u[i] = sum / L[i * n + i];
+	}
+
+	// Clip to the bounds and polish with projected gradient if anything hit them.
+	bool clipped = false;
+	for (int i = 0; i < n; ++i) {
+		if (fabs(u[i]) > uMax) {
+			u[i] = ofClamp(u[i], -uMax, uMax);
+			clipped = true;
+		}
+	}
+	if (clipped && hNorm > 0) {
+		const double step = 1.0 / hNorm;
+		for (int iter = 0; iter < kProjectedGradientIters; ++iter) {
+			for (int i = 0; i < n; ++i) {
+				double grad = g[i];
+				for (int j = 0; j < n; ++j) {
+					grad += H[i * n + j] * u[j];
+				}
+				tmp[i] = ofClamp(u[i] - step * grad, -uMax, uMax);
+			}
+			u.swap(tmp);
+		}
+	}
+
+	lastCommand = u[0];
+	lateralVel += (lastCommand - lateralVel) * min(1.0f, dt / lagSec);
+	return lastCommand;
+}
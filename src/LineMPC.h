@@ -0,0 +1,50 @@
+//
+//  LineMPC.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef LineMPC_h
+#define LineMPC_h
+
+#include "ofMain.h"
+
+// Short-horizon model-predictive controller for the cross-track error to
+// the current segment. The robot's lateral velocity is modelled as a
+// first-order lag on the commanded one, so over the horizon
+//
+//   v[k+1] = v[k] + (u[k] - v[k]) * dt / lag
+//   e[k+1] = e[k] + dt * v[k+1]
+//
+// and we minimise sum(q e^2 + r u^2 + rd du^2) subject to |u| <= uMax.
+// The QP's Hessian only depends on the configuration, so it is factored
+// once and each solve is a few small matrix-vector products.
+class LineMPC {
+public:
+	LineMPC();
+
+	void configure(int horizon, float stepSec, float lagSec, float q, float r, float rd);
+
+	// Reset the internal lateral velocity estimate, e.g. at a segment start.
+	void reset();
+
+	// Returns the lateral velocity (m/s, along +normal) to command given the
+	// signed cross-track error (m). dt advances the internal model.
+	float solve(float crossTrack, float uMax, float dt);
+
+	int horizon;
+	float stepSec, lagSec;
+	float q, r, rd;
+
+	float lateralVel, lastCommand;
+
+private:
+	// Row-major N x N / N x 2 matrices
+	vector<double> H, L, gammaE, phiE;
+	double hNorm;
+	vector<double> g, u, tmp;
+};
+
+#endif /* LineMPC_h */
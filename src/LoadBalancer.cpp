@@ -0,0 +1,93 @@
+//
+//  LoadBalancer.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "LoadBalancer.h"
+
+LoadBalancer::LoadBalancer() :
+	steals(0)
+{}
+
+map<string, float> LoadBalancer::remainingLength(Map &m) {
+	map<string, float> remaining;
+	for (auto &p : m.mapPathStore) {
+		if (!m.activePaths[p.first]) continue;
+
+		float length = m.undrawnOnDisk(p.first);
+		for (const MapPath &mp : p.second) {
+			if (!mp.drawn && !mp.claimed) {
+				length += mp.segment.start.distance(mp.segment.end);
+			}
+		}
+		remaining[p.first] = length;
+	}
+	return remaining;
+}
+
+static map<string, int> robotsPerType(const map<int, set<string>> &pathTypes) {
+	map<string, int> count;
+	for (auto &p : pathTypes) {
+		for (const string &type : p.second) {
+			count[type]++;
+		}
+	}
+	return count;
+}
+
+map<int, float> LoadBalancer::loadByRobot(const map<string, float> &remaining, const map<int, set<string>> &pathTypes) {
+	const map<string, int> sharers = robotsPerType(pathTypes);
+
+	map<int, float> load;
+	for (auto &p : pathTypes) {
+		load[p.first] = 0;
+		for (const string &type : p.second) {
+			auto r = remaining.find(type);
+			if (r != remaining.end()) {
+				load[p.first] += r->second / sharers.at(type);
+			}
+		}
+	}
+	return load;
+}
+
+LoadSteal LoadBalancer::steal(int robotId, const map<string, float> &remaining, const map<int, set<string>> &pathTypes) {
+	LoadSteal result = { robotId, -1, "" };
+
+	const map<string, int> sharers = robotsPerType(pathTypes);
+	const map<int, float> load = loadByRobot(remaining, pathTypes);
+	const set<string> &own = pathTypes.at(robotId);
+
+	// Most loaded robot first, then whichever of its types has the most
+	// work per robot
+	vector<pair<float, int>> donors;
+	for (auto &p : load) {
+		if (p.first != robotId && p.second > 0) {
+			donors.push_back(make_pair(p.second, p.first));
+		}
+	}
+	sort(donors.rbegin(), donors.rend());
+
+	for (auto &donor : donors) {
+		float best = 0;
+		for (const string &type : pathTypes.at(donor.second)) {
+			auto r = remaining.find(type);
+			if (own.count(type) || r == remaining.end()) continue;
+
+			const float share = r->second / sharers.at(type);
+			if (share > best) {
+				best = share;
+				result.fromRobotId = donor.second;
+				result.pathType = type;
+			}
+		}
+		if (result.fromRobotId >= 0) {
+			steals++;
+			return result;
+		}
+	}
+	return result;
+}
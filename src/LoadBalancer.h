@@ -0,0 +1,41 @@
+//
+//  LoadBalancer.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef LoadBalancer_h
+#define LoadBalancer_h
+
+#include "ofMain.h"
+#include "Map.h"
+
+typedef struct LoadSteal {
+	int robotId, fromRobotId;
+	string pathType;
+} LoadSteal;
+
+// Keeps robots busy until the whole map is done. Each path type's remaining
+// length is shared between the robots drawing it; when a robot runs out, it
+// takes on the type with the most work per robot from the most loaded one.
+class LoadBalancer {
+public:
+	LoadBalancer();
+
+	// Pen-down length of the segments nobody has drawn or claimed yet, by
+	// active path type
+	static map<string, float> remainingLength(Map &map);
+
+	// Each robot's share of the remaining length
+	static map<int, float> loadByRobot(const map<string, float> &remaining, const map<int, set<string>> &pathTypes);
+
+	// Work for a robot that ran out, fromRobotId -1 if there's none left
+	LoadSteal steal(int robotId, const map<string, float> &remaining, const map<int, set<string>> &pathTypes);
+
+	// Types handed over since the last reset
+	int steals;
+};
+
+#endif /* LoadBalancer_h */
@@ -7,16 +7,46 @@
 //
 
 #include "Map.h"
+#include "Profiler.h"
+#include "SegmentClip.h"
+#include "CollinearDedupe.h"
+#include "MapWatcher.h"
+
+#include <unordered_map>
+
+// Paths outside any group with an id, or GeoJSON features without the
+// type property
+static const string kDefaultPathType = "paths";
+static const string kPathTypeProperty = "layer";
+
+// Curves become lines that stray at most half the pen's width
+static const float kPenWidthM = 0.002f;
+static const float kCurveToleranceM = kPenWidthM / 2;
+// Collinear segments closer than this are drawn over each other
+static const float kOverlapToleranceM = kPenWidthM / 2;
+// Polyline points this close to the line through their neighbours go
+static const float kSimplifyToleranceM = kPenWidthM / 4;
+// Drawn segments are looked up in a grid of cells this many overlap
+// tolerances wide
+static const int kCoverCellTolerances = 16;
 
 Map::Map(float width, float height, float offsetX, float offsetY, ofRectangle crop):
+	simplifyToleranceM(kSimplifyToleranceM),
+	pathTypeProperty(kPathTypeProperty),
+	tileLoads(0), tileWrites(0),
 	widthM(width), heightM(height),
 	offsetX(offsetX), offsetY(offsetY),
 	origOffsetX(offsetX), origOffsetY(offsetY),
 	svgExtentMin(10000), svgExtentMax(-10000),
 	storeCount(0), pathCount(0),
-	cropBox(crop)
+	cropBox(crop),
+	tiles(NULL)
 {}
 
+Map::~Map() {
+	closeTiles();
+}
+
 void Map::storePath(string lineType, float startX, float startY, float destX, float destY) {
     // be wary of strings with types of the same first two letters
 
@@ -87,11 +117,9 @@ void Map::setPathActive(string lineType, bool active) {
 
 int Map::getActivePathCount() {
 	int count = 0;
-	for (auto &i : mapPathStore) {
-		if (activePaths[i.first]) {
-			for (auto &j : i.second) {
-				count++;
-			}
+	for (auto &type : pathTypes) {
+		if (activePaths[type]) {
+			count += typeCounts(type).total;
 		}
 	}
 	return count;
@@ -99,11 +127,9 @@ int Map::getActivePathCount() {
 
 int Map::getDrawnPaths() {
 	int count = 0;
-	for (auto &i : mapPathStore) {
-		if (activePaths[i.first]) {
-			for (auto &j : i.second) {
-				if (j.drawn) count++;
-			}
+	for (auto &type : pathTypes) {
+		if (activePaths[type]) {
+			count += typeCounts(type).drawn;
 		}
 	}
 	return count;
@@ -112,19 +138,50 @@ int Map::getDrawnPaths() {
 int Map::getPathCount() {
 	int count = 0;
 	for (auto type: pathTypes) {
-		for (auto path: mapPathStore[type]) {
-			count++;
-		}
+		count += typeCounts(type).total;
 	}
 	return count;
 }
 
 int Map::getPathCount(string type) {
-	int count = 0;
-	for (auto path: mapPathStore[type]) {
-		count++;
+	return typeCounts(type).total;
+}
+
+// Resident paths as they are in memory, the rest as last written
+TileCounts Map::typeCounts(const string &type) {
+	TileCounts c = { 0, 0 };
+	if (tiles) {
+		c = tiles->totals[type];
+		for (int tile : residentTiles) {
+			auto written = tiles->counts[tile].find(type);
+			if (written != tiles->counts[tile].end()) {
+				c.total -= written->second.total;
+				c.drawn -= written->second.drawn;
+			}
+		}
 	}
-	return count;
+
+	for (auto &path : mapPathStore[type]) {
+		c.total++;
+		if (path.drawn) c.drawn++;
+	}
+	return c;
+}
+
+float Map::undrawnOnDisk(const string &type) {
+	if (!tiles) {
+		return 0;
+	}
+
+	TileCounts c = tiles->totals[type];
+	for (int tile : residentTiles) {
+		auto written = tiles->counts[tile].find(type);
+		if (written != tiles->counts[tile].end()) {
+			c.lengthM -= written->second.lengthM;
+			c.drawnM -= written->second.drawnM;
+		}
+	}
+	return max(0.f, c.lengthM - c.drawnM);
 }
 
 float getAngle(ofVec2f start, ofVec2f end) {
@@ -234,27 +291,43 @@ string Map::getMostRecentMap(string filePath) {
 
     for(int i = 0; i < dir.size(); i++){
         string fileName = ofToString(dir.getPath(i));
-        regex r("maproom-(.+)\\.svg");
-        smatch m;
-        regex_search(fileName, m, r);
-        for(auto v: m) {
-            if (ofToString(v).size() == 24) {
-                if (mostRecentTime != "") {
-                    mostRecentTime = v;
-                    file = fileName;
-                } else if(v.compare(mostRecentTime) > 0) {
-                    mostRecentTime = v;
-                    file = fileName;
-                }
-            }
+        string timestamp;
+        if (MapWatcher::mapTimestamp(fileName, timestamp) && timestamp > mostRecentTime) {
+            mostRecentTime = timestamp;
+            file = fileName;
         }
     }
     return file;
 }
 
-void Map::loadMap(const string filename) {
+void Map::loadMap(const string filename, const MapFrame *frame) {
+	MR_PROFILE_SCOPE("Map::loadMap");
+	loadPaths(filename);
+	if (frame) {
+		svgExtentMin = frame->min;
+		svgExtentMax = frame->max;
+	}
+	rescaleMap(widthM, heightM, origOffsetX, origOffsetY);
+
+	if (simplifyToleranceM > 0) {
+		const SimplifyStats stats = simplifyPaths(simplifyToleranceM);
+		cout << "Simplified " << stats.before << " segments to " << stats.after << endl;
+	}
+}
+
+MapFrame Map::getFrame() {
+	return { svgExtentMin, svgExtentMax };
+}
+
+Map* Map::blankCopy() {
+	Map *copy = new Map(widthM, heightM, origOffsetX, origOffsetY, cropBox);
+	copy->simplifyToleranceM = simplifyToleranceM;
+	copy->pathTypeProperty = pathTypeProperty;
+	return copy;
+}
+
+void Map::loadPaths(const string &filename) {
 	currentMap.clear();
-    currentMap.loadFile(filename);
 	scaleX = 1.0;
 	scaleY = 1.0;
 	offsetX = 0.0;
@@ -262,132 +335,311 @@ void Map::loadMap(const string filename) {
 	svgExtentMin = ofVec2f(10000);
 	svgExtentMax = ofVec2f(-10000);
 
+	closeTiles();
     clearStore();
-    
-    currentMap.pushTag("svg");
-    int firstLevel = currentMap.getNumTags("g");
-    for (int i = 0; i < firstLevel; i++) {
-        currentMap.pushTag("g", i);
-        int secondLevel = currentMap.getNumTags("g");
-        for (int j = 0; j < secondLevel; j++) {
-            string lineType = ofToString(currentMap.getAttribute("g", "id", "", j));
-            currentMap.pushTag("g", j);
-            int thirdLevel = currentMap.getNumTags("path");
-            for (int k = 0; k < thirdLevel; k++) {
-                string path = ofToString(currentMap.getAttribute("path", "d", "", k));
-                int startIndex, endIndex, firstX, firstY;
-                float move_x, move_y, dest_x, dest_y, last_x, last_y;
-                int state = 1;
-                
-                for (int l = 0; l < path.size(); l++) {
-                    switch (state) {
-                        case 1: // M -> comma
-                            if (path[l] == 'M') {
-                                startIndex = l+1;
-                            }
-                            if (path[l] == ',') {
-                                endIndex = l-1;
-                                move_x = stof(path.substr(startIndex, endIndex));
-                                startIndex = l+1;
-                                state = 2;
-                            }
-                            break;
-                        case 2: // comma -> L [after M]
-                            if (path[l] == 'L') {
-                                endIndex = l-1;
-                                // store incase there is a Z
-                                move_y = stof(path.substr(startIndex, endIndex));
-								firstX = move_x;
-								firstY = move_y;
-                                startIndex = l+1;
-                                state = 3;
-                            }
-                            break;
-                        case 3: // L -> comma [after M -> comma]
-                            if (path[l] == ',') {
-                                endIndex = l-1;
-                                dest_x = stof(path.substr(startIndex, endIndex));
-                                startIndex = l+1;
-                                state = 4;
-                            }
-                            break;
-                        case 4: // comma -> (L || M) [after M -> comma -> L]
-                            if (path[l] == 'L') {
-                                endIndex = l-1;
-                                dest_y = stof(path.substr(startIndex, endIndex));
-                                storePath(lineType, move_x, move_y, dest_x, dest_y);
-                                pathCount++;
-                                last_x = dest_x;
-                                last_y = dest_y;
-                                startIndex = l+1;
-                                state = 5;
-                            } else if (path[l] == 'M') {
-                                endIndex = l-1;
-                                dest_y = stof(path.substr(startIndex, endIndex));
-                                storePath(lineType, move_x, move_y, dest_x, dest_y);
-                                pathCount++;
-                                startIndex = l+1;
-                                state = 1;
-                            }
-                            break;
-                        case 5: // L -> comma [after L]
-                            if (path[l] == ',') {
-                                endIndex = l-1;
-                                dest_x = stof(path.substr(startIndex, endIndex));
-                                startIndex = l+1;
-                                state = 6;
-                            }
-                            break;
-                        case 6: // comma -> L || M [after L -> comma]
-                            if (path[l] == 'L') {
-                                endIndex = l-1;
-                                dest_y = stof(path.substr(startIndex, endIndex));
-                                storePath(lineType, last_x, last_y, dest_x, dest_y);
-                                pathCount++;
-                                last_x = dest_x;
-                                last_y = dest_y;
-                                startIndex = l+1;
-                                state = 5;
-                            } else if (path[l] == 'M') {
-                                endIndex = l-1;
-                                dest_y = stof(path.substr(startIndex, endIndex));
-                                storePath(lineType, last_x, last_y, dest_x, dest_y);
-                                pathCount++;
-                                startIndex = l+1;
-                                state = 1;
-                            } else if (path[l] == 'Z') {
-                                endIndex = l-1;
-                                dest_y = stof(path.substr(startIndex, endIndex));
-                                storePath(lineType, dest_x, dest_y, firstX, firstY);
-                                pathCount++;
-                                state = 1;
-                            }
-                            break;
-                        default:
-                            cout << "unknown state reached in Map.cpp" << endl;
-                            break;
-                    }
-                    // reaches end of string
-                    if (l == path.size()-1) {
-                        endIndex = l;
-                        dest_y = stof(path.substr(startIndex, endIndex));
-                        if (state == 6) {
-                            storePath(lineType, last_x, last_y, dest_x, dest_y);
-                            pathCount++;
-                        } else {
-                            storePath(lineType, move_x, move_y, dest_x, dest_y);
-                            pathCount++;
-                        }
-                    }
-                }
-            }
-            currentMap.popTag();
-        }
-        currentMap.popTag();
-    }
-    currentMap.popTag();
+	// Ids are the same each time a map is loaded, journals rely on it
+	storeCount = 0;
 
-	rescaleMap(widthM, heightM, origOffsetX, origOffsetY);
+	const string ext = ofToLower(ofFilePath::getFileExt(filename));
+	if (ext == "geojson" || ext == "json") {
+		loadGeoJson(filename);
+	} else {
+		loadSvg(filename);
+	}
+}
+
+// Type and both ends to a tenth of a millimeter, whichever way round
+typedef tuple<string, int, int, int, int> SegmentKey;
+static SegmentKey segmentKey(const MapPath &path) {
+	static const float kKeyPerM = 10000;
+	int x0 = lround(path.segment.start.x * kKeyPerM), y0 = lround(path.segment.start.y * kKeyPerM);
+	int x1 = lround(path.segment.end.x * kKeyPerM), y1 = lround(path.segment.end.y * kKeyPerM);
+	if (make_pair(x1, y1) < make_pair(x0, y0)) {
+		swap(x0, x1);
+		swap(y0, y1);
+	}
+	return make_tuple(path.type, x0, y0, x1, y1);
+}
+
+bool Map::mergeMap(Map &incoming, map<int, int> &renamed, MergeStats &stats) {
+	MR_PROFILE_SCOPE("Map::mergeMap");
+	stats = { 0, 0, 0, 0 };
+	renamed.clear();
+
+	if (incoming.pathCount == 0) {
+		cout << "Nothing to merge" << endl;
+		return false;
+	}
+
+	multimap<SegmentKey, MapPath*> current;
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			current.insert(make_pair(segmentKey(path), &path));
+		}
+	}
+
+	// Segments in both keep their progress and take the new id
+	map<string, vector<MapPath>> merged;
+	int nextId = 0;
+	for (auto &type : incoming.pathTypes) {
+		for (auto &path : incoming.mapPathStore[type]) {
+			auto match = current.find(segmentKey(path));
+			if (match != current.end()) {
+				path.claimed = match->second->claimed;
+				path.drawn = path.drawn || match->second->drawn;
+				renamed[match->second->id] = path.id;
+				current.erase(match);
+				stats.kept++;
+			} else if (path.drawn) {
+				stats.covered++;
+			} else {
+				stats.added++;
+			}
+			merged[type].push_back(path);
+			nextId = max(nextId, path.id + 1);
+		}
+	}
+
+	// Gone segments a robot is drawing stay until it's done
+	for (auto &p : current) {
+		MapPath path = *p.second;
+		if (path.claimed && !path.drawn) {
+			path.id = nextId++;
+			renamed[p.second->id] = path.id;
+			merged[path.type].push_back(path);
+		} else {
+			stats.removed++;
+		}
+	}
+
+	vector<string> types;
+	for (auto &type : pathTypes) {
+		if (merged.count(type)) types.push_back(type);
+	}
+	for (auto &type : incoming.pathTypes) {
+		if (merged.count(type) && find(types.begin(), types.end(), type) == types.end()) {
+			types.push_back(type);
+			if (!activePaths.count(type)) activePaths[type] = true;
+		}
+	}
+	pathTypes.swap(types);
+	mapPathStore.swap(merged);
+	storeCount = nextId;
+	pathCount = incoming.pathCount;
+	svgExtentMin = incoming.svgExtentMin;
+	svgExtentMax = incoming.svgExtentMax;
+	scaleX = incoming.scaleX;
+	scaleY = incoming.scaleY;
+	offsetX = incoming.offsetX;
+	offsetY = incoming.offsetY;
+	return true;
+}
+
+void Map::getDrawnSegments(map<string, SegmentBatch> &drawn) {
+	drawn.clear();
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			if (path.drawn) drawn[p.first].push(path.segment.start, path.segment.end);
+		}
+	}
+}
+
+static int64_t cellKey(int cx, int cy) {
+	return ((int64_t)cx << 32) ^ (uint32_t)cy;
+}
+
+static float squareDistanceToSegment(const ofVec2f &p, const ofVec2f &a, const ofVec2f &b) {
+	const ofVec2f ab = b - a;
+	const float t = ofClamp((p - a).dot(ab) / max(ab.lengthSquared(), 1e-12f), 0, 1);
+	return p.squareDistance(a + ab * t);
+}
+
+int Map::markDrawnOver(const map<string, SegmentBatch> &drawn) {
+	MR_PROFILE_SCOPE("Map::markDrawnOver");
+	const float tolerance = kOverlapToleranceM, cellSize = kOverlapToleranceM * kCoverCellTolerances;
+	int marked = 0;
+	unordered_map<int64_t, vector<int>> grid;
+	for (auto &p : mapPathStore) {
+		auto over = drawn.find(p.first);
+		if (over == drawn.end()) continue;
+		const SegmentBatch &lines = over->second;
+
+		// Each drawn segment is in every cell within the tolerance of its
+		// bounds, so a point that close to it only looks in its own cell
+		grid.clear();
+		for (int i = 0; i < lines.size(); ++i) {
+			const ofVec2f s = lines.start(i), e = lines.end(i);
+			const int x0 = floor((min(s.x, e.x) - tolerance) / cellSize), x1 = floor((max(s.x, e.x) + tolerance) / cellSize);
+			const int y0 = floor((min(s.y, e.y) - tolerance) / cellSize), y1 = floor((max(s.y, e.y) + tolerance) / cellSize);
+			for (int cx = x0; cx <= x1; ++cx) {
+				for (int cy = y0; cy <= y1; ++cy) {
+					grid[cellKey(cx, cy)].push_back(i);
+				}
+			}
+		}
+
+		// Drawn over if points the tolerance apart along it all are
+		for (auto &path : p.second) {
+			if (path.drawn) continue;
+
+			const ofVec2f a = path.segment.start, b = path.segment.end;
+			const int steps = max(1, (int)ceil(a.distance(b) / tolerance));
+			bool covered = true;
+			for (int k = 0; k <= steps && covered; ++k) {
+				const ofVec2f q = a + (b - a) * ((float)k / steps);
+				auto cell = grid.find(cellKey(floor(q.x / cellSize), floor(q.y / cellSize)));
+				covered = false;
+				if (cell == grid.end()) break;
+				for (int i : cell->second) {
+					if (squareDistanceToSegment(q, lines.start(i), lines.end(i)) <= tolerance * tolerance) {
+						covered = true;
+						break;
+					}
+				}
+			}
+			if (covered) {
+				path.drawn = true;
+				marked++;
+			}
+		}
+	}
+	return marked;
+}
+
+void Map::loadSvg(const string &filename) {
+    currentMap.loadFile(filename);
+
+	vector<pair<string, SvgPath>> svgPaths;
+	if (currentMap.pushTag("svg")) {
+		collectPaths(SvgTransform::identity(), kDefaultPathType, svgPaths);
+		currentMap.popTag();
+	}
+
+	// The map is stretched to fill widthM x heightM, so the tolerance in
+	// SVG units depends on its size
+	ofVec2f minP(INFINITY), maxP(-INFINITY);
+	for (auto &p : svgPaths) {
+		p.second.extend(minP, maxP);
+	}
+	const float svgPerMX = (maxP.x - minP.x) / widthM, svgPerMY = (maxP.y - minP.y) / heightM;
+	const float svgPerM = min(svgPerMX, svgPerMY) > 0 ? min(svgPerMX, svgPerMY) : max(svgPerMX, svgPerMY);
+
+	vector<pair<ofVec2f, ofVec2f>> lines;
+	for (auto &p : svgPaths) {
+		lines.clear();
+		p.second.flatten(kCurveToleranceM * svgPerM, lines);
+		for (auto &line : lines) {
+			if (line.first == line.second) continue;
+
+			storePath(p.first, line.first.x, line.first.y, line.second.x, line.second.y);
+			pathCount++;
+		}
+	}
+}
+
+// Projected meters stand in for SVG units, rescaleMap fits them the same way
+void Map::loadGeoJson(const string &filename) {
+	GeoJsonReader reader(pathTypeProperty);
+	reader.read(filename, [&](const string &type, const vector<ofVec2f> &line) {
+		for (int i = 1; i < line.size(); ++i) {
+			if (line[i - 1] == line[i]) continue;
+
+			storePath(type.empty() ? kDefaultPathType : type, line[i - 1].x, line[i - 1].y, line[i].x, line[i].y);
+			pathCount++;
+		}
+	});
+	cout << "Read " << reader.lines << " lines in " << reader.features << " features from " << filename << endl;
+}
+
+SimplifyStats Map::simplifyPaths(float toleranceM) {
+	MR_PROFILE_SCOPE("Map::simplifyPaths");
+	SimplifyStats stats = { getPathCount(), 0 };
+
+	vector<vector<MapPath>*> stores;
+	for (auto &type : pathTypes) {
+		stores.push_back(&mapPathStore[type]);
+	}
+
+	// Each type only touches its own store
+	auto simplifyType = [toleranceM](vector<MapPath> &store) {
+		vector<MapPath> simplified;
+		vector<pair<ofVec2f, ofVec2f>> segments;
+		for (auto &mapPath : store) {
+			if (mapPath.claimed || mapPath.drawn) {
+				simplified.push_back(mapPath);
+			} else {
+				segments.push_back(make_pair(mapPath.segment.start, mapPath.segment.end));
+			}
+		}
+		if (segments.empty()) {
+			return;
+		}
+
+		const string type = store[0].type;
+		for (auto &line : joinSegments(segments)) {
+			const vector<ofVec2f> points = simplifyPolyline(line, toleranceM);
+			for (int i = 1; i < points.size(); ++i) {
+				MapPath mapPath = { -1, false, false, type };
+				mapPath.segment.start = points[i - 1];
+				mapPath.segment.end = points[i];
+				simplified.push_back(mapPath);
+			}
+		}
+		store.swap(simplified);
+	};
+
+	const int numThreads = min((int)stores.size(), max(1, (int)thread::hardware_concurrency()));
+	atomic<int> next(0);
+	vector<thread> workers;
+	for (int t = 0; t < numThreads; ++t) {
+		workers.push_back(thread([&]() {
+			for (int i = next++; i < stores.size(); i = next++) {
+				simplifyType(*stores[i]);
+			}
+		}));
+	}
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	// New segments get ids in order, and SVG coordinates so a later
+	// rescale puts them back where they are now
+	for (auto store : stores) {
+		for (auto &mapPath : *store) {
+			if (mapPath.id >= 0) continue;
+
+			mapPath.id = storeCount++;
+			pathSegment &s = mapPath.segment;
+			s.prescaleStart = ofVec2f((s.start.x - offsetX) / scaleX, (s.start.y - offsetY) / scaleY);
+			s.prescaleEnd = ofVec2f((s.end.x - offsetX) / scaleX, (s.end.y - offsetY) / scaleY);
+		}
+	}
+
+	stats.after = getPathCount();
+	return stats;
+}
+
+// Paths anywhere below the current tag, typed by the id of the nearest
+// group that has one
+void Map::collectPaths(const SvgTransform &parent, const string &lineType, vector<pair<string, SvgPath>> &found) {
+	const int numPaths = currentMap.getNumTags("path");
+	for (int k = 0; k < numPaths; k++) {
+		const SvgTransform transform = parent * SvgTransform::parse(currentMap.getAttribute("path", "transform", "", k));
+		SvgPath path;
+		if (!path.parse(currentMap.getAttribute("path", "d", "", k), transform)) {
+			cout << "Bad path data in " << lineType << ", keeping what came before the error" << endl;
+		}
+		found.push_back(make_pair(lineType, path));
+	}
+
+	const int numGroups = currentMap.getNumTags("g");
+	for (int j = 0; j < numGroups; j++) {
+		const string id = currentMap.getAttribute("g", "id", "", j);
+		const SvgTransform transform = parent * SvgTransform::parse(currentMap.getAttribute("g", "transform", "", j));
+		currentMap.pushTag("g", j);
+		collectPaths(transform, id.empty() ? lineType : id, found);
+		currentMap.popTag();
+	}
 }
 
 void Map::rescaleMap(float width, float height, float newOffsetX, float newOffsetY) {
@@ -405,43 +657,74 @@ void Map::rescaleMap(float width, float height, float newOffsetX, float newOffse
 	offsetY = newOffsetY - svgExtentMin.y * scaleY;
 	const ofVec2f offset(offsetX, offsetY);
 
+	SegmentBatch batch, lines;
+	vector<uint8_t> inside;
+	vector<SegmentPiece> pieces;
+	vector<MapPath> kept;
+	DedupeStats dedupe = { 0, 0, 0 };
 	for (auto &path : pathTypes) {
 		if (mapPathStore.find(path) == mapPathStore.end()) {
 			continue;
 		}
+		vector<MapPath> &store = mapPathStore[path];
 
-		for (auto mapPathIt = mapPathStore[path].begin(); mapPathIt != mapPathStore[path].end(); /* no increment */)
-		{
-			MapPath &mapPath = *mapPathIt;
+		// Claimed and drawn paths stay where they are, the rest move and are
+		// clipped to the crop box together
+		batch.clear();
+		for (auto &mapPath : store) {
+			if (mapPath.claimed || mapPath.drawn) continue;
+			batch.push(mapPath.segment.prescaleStart * scale + offset, mapPath.segment.prescaleEnd * scale + offset);
+		}
+		clipSegments(batch, cropBox, inside);
 
+		// Then cut back to what they add to the paths that stay and the
+		// ones before them on the same line
+		lines.clear();
+		for (auto &mapPath : store) {
 			if (mapPath.claimed || mapPath.drawn) {
-				continue;
+				lines.push(mapPath.segment.start, mapPath.segment.end);
 			}
+		}
+		const int fixed = lines.size();
+		for (int i = 0; i < batch.size(); ++i) {
+			if (inside[i]) lines.push(batch.start(i), batch.end(i));
+		}
+		const DedupeStats stats = dedupeCollinear(lines, fixed, kOverlapToleranceM, pieces);
+		dedupe.removed += stats.removed;
+		dedupe.trimmed += stats.trimmed;
+		dedupe.split += stats.split;
 
-			mapPath.segment.start = mapPath.segment.prescaleStart * scale + offset;
-			mapPath.segment.end = mapPath.segment.prescaleEnd * scale + offset;
-
-			bool success = CohenSutherlandLineClip(mapPath.segment.start, mapPath.segment.end, cropBox);
+		kept.clear();
+		kept.reserve(store.size());
+		int b = 0, line = fixed, p = 0;
+		for (auto &mapPath : store) {
+			if (mapPath.claimed || mapPath.drawn) {
+				kept.push_back(mapPath);
+				continue;
+			}
+			const int i = b++;
+			if (!inside[i]) continue;
 
-			static const float kEpsilon = 0.005;
-			for (auto &otherMapPath : mapPathStore[path]) {
-				if (otherMapPath.id == mapPath.id) {
-					continue;
+			// A segment cut in several takes new ids for the rest
+			const int l = line++;
+			for (int first = p; p < pieces.size() && pieces[p].source == l; ++p) {
+				MapPath piece = mapPath;
+				if (p > first) {
+					piece.id = storeCount++;
 				}
-
-				if ((mapPath.segment.start.distance(otherMapPath.segment.start) < kEpsilon && mapPath.segment.end.distance(otherMapPath.segment.end) < kEpsilon)
-					|| (mapPath.segment.start.distance(otherMapPath.segment.end) < kEpsilon && mapPath.segment.end.distance(otherMapPath.segment.start) < kEpsilon)) {
-					success = false;
-					break;
+				piece.segment.start = pieces[p].start;
+				piece.segment.end = pieces[p].end;
+				if (pieces[p].start != batch.start(i) || pieces[p].end != batch.end(i)) {
+					piece.segment.prescaleStart = (pieces[p].start - offset) / scale;
+					piece.segment.prescaleEnd = (pieces[p].end - offset) / scale;
 				}
-			}
-
-			if (!success) {
-				mapPathIt = mapPathStore[path].erase(mapPathIt);
-			} else {
-				++mapPathIt;
+				kept.push_back(piece);
 			}
 		}
+		store.swap(kept);
+	}
+	if (dedupe.removed + dedupe.trimmed + dedupe.split > 0) {
+		cout << "Overlapping segments: " << dedupe.removed << " dropped, " << dedupe.trimmed << " trimmed, " << dedupe.split << " split" << endl;
 	}
     
 //    cout << "pre optimize count: " << getPathCount() << endl;
@@ -451,7 +734,8 @@ void Map::rescaleMap(float width, float height, float newOffsetX, float newOffse
 //    cout << "post optimize count: " << getPathCount() << endl;
 }
 
-MapPath* Map::nextPath(const ofVec2f &pos, int robotId, float lastHeading, const set<string> &pathTypes) {
+MapPath* Map::nextPath(const ofVec2f &pos, int robotId, float lastHeading, const set<string> &pathTypes, const function<bool(const MapPath&)> &accept) {
+	MR_PROFILE_SCOPE("Map::nextPath");
     MapPath *next = NULL;
     vector<MapPath*> contenders;
     float minDist = INFINITY;
@@ -477,6 +761,11 @@ MapPath* Map::nextPath(const ofVec2f &pos, int robotId, float lastHeading, const
             float startDist = mapPath.segment.start.distance(pos);
             float endDist = mapPath.segment.end.distance(pos);
 
+            // Only ask about paths that would be picked
+            if (accept && min(startDist, endDist) < minDist + 0.0001 && !accept(mapPath)) {
+                continue;
+            }
+
             if (startDist < minDist) {
                 minDist = startDist;
                 contenders.clear();
@@ -512,3 +801,327 @@ MapPath* Map::nextPath(const ofVec2f &pos, int robotId, float lastHeading, const
     }
 }
 
+
+bool Map::isTiled() {
+	return tiles != NULL;
+}
+
+bool Map::writeTiles(const string &dir, float tileSizeM) {
+	MR_PROFILE_SCOPE("Map::writeTiles");
+	if (tiles) {
+		cout << "Map is already tiled" << endl;
+		return false;
+	}
+
+	ofVec2f minP(INFINITY), maxP(-INFINITY);
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			for (const ofVec2f &v : { path.segment.start, path.segment.end }) {
+				minP.x = min(minP.x, v.x);
+				minP.y = min(minP.y, v.y);
+				maxP.x = max(maxP.x, v.x);
+				maxP.y = max(maxP.y, v.y);
+			}
+		}
+	}
+	if (minP.x > maxP.x) {
+		cout << "No paths to tile" << endl;
+		return false;
+	}
+
+	TileStore *store = new TileStore();
+	if (!store->create(dir, ofRectangle(minP, maxP), tileSizeM, pathTypes)) {
+		delete store;
+		return false;
+	}
+	for (auto &type : pathTypes) {
+		for (auto &path : mapPathStore[type]) {
+			store->add(path);
+		}
+	}
+	if (!store->finish()) {
+		delete store;
+		return false;
+	}
+
+	tiles = store;
+	residentTiles.clear();
+	for (auto &p : mapPathStore) {
+		p.second.clear();
+	}
+	return true;
+}
+
+bool Map::openTiles(const string &dir) {
+	closeTiles();
+	clearStore();
+
+	TileStore *store = new TileStore();
+	if (!store->open(dir)) {
+		delete store;
+		return false;
+	}
+
+	tiles = store;
+	for (auto &type : tiles->pathTypes) {
+		pathTypes.push_back(type);
+		mapPathStore[type];
+		activePaths[type] = true;
+	}
+	return true;
+}
+
+void Map::closeTiles() {
+	if (!tiles) {
+		return;
+	}
+
+	flushTiles();
+	delete tiles;
+	tiles = NULL;
+	residentTiles.clear();
+}
+
+bool Map::writeBack(const set<int> &tileSet) {
+	map<int, vector<MapPath>> byTile;
+	for (int tile : tileSet) {
+		byTile[tile];
+	}
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			auto t = byTile.find(tiles->tileOf(path));
+			if (t != byTile.end()) {
+				t->second.push_back(path);
+			}
+		}
+	}
+
+	bool wrote = false;
+	for (auto &p : byTile) {
+		// Only drawn flags change while a tile is loaded
+		int drawn = 0;
+		for (auto &path : p.second) {
+			if (path.drawn) drawn++;
+		}
+		int written = 0;
+		for (auto &c : tiles->counts[p.first]) {
+			written += c.second.drawn;
+		}
+		if (drawn == written && !tiles->stale.count(p.first)) continue;
+
+		tiles->writeTile(p.first, p.second);
+		tileWrites++;
+		wrote = true;
+	}
+	return wrote;
+}
+
+void Map::flushTiles() {
+	if (!tiles) {
+		return;
+	}
+
+	tiles->waitWritten();
+	tileWrites += tiles->collectWritten();
+	writeBack(residentTiles);
+	tiles->saveIndex();
+	tiles->waitWritten();
+}
+
+bool Map::updateResidentTiles(const vector<pair<ofVec2f, set<string>>> &robots, float marginM) {
+	if (!tiles) {
+		return false;
+	}
+	MR_PROFILE_SCOPE("Map::updateResidentTiles");
+
+	const int written = tiles->collectWritten();
+	if (written > 0) {
+		tileWrites += written;
+		tiles->saveIndex();
+	}
+
+	set<int> wanted;
+	map<int, set<string>> residentWork;
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			if (path.claimed && !path.drawn) {
+				wanted.insert(tiles->tileOf(path));
+			} else if (!path.drawn) {
+				residentWork[tiles->tileOf(path)].insert(p.first);
+			}
+		}
+	}
+
+	auto hasWork = [&](int tile, const set<string> &types) {
+		if (residentTiles.count(tile)) {
+			auto work = residentWork.find(tile);
+			if (work == residentWork.end()) return false;
+			for (auto &type : work->second) {
+				if (activePaths[type] && types.count(type)) return true;
+			}
+			return false;
+		}
+		for (auto &c : tiles->counts[tile]) {
+			if (activePaths[c.first] && types.count(c.first) && c.second.drawn < c.second.total) return true;
+		}
+		return false;
+	};
+
+	// Segments reach past their tile, and loaded tiles stay until their
+	// robot is another tile away so moving along an edge doesn't thrash
+	const float reach = marginM + tiles->overhangM;
+	set<int> keep;
+	for (auto &r : robots) {
+		set<int> near;
+		tiles->tilesNear(r.first, reach, near);
+		tiles->tilesNear(r.first, reach + tiles->tileSizeM, keep);
+
+		bool work = false;
+		for (int tile : near) {
+			work = work || hasWork(tile, r.second);
+		}
+		wanted.insert(near.begin(), near.end());
+		if (work) continue;
+
+		int nearest = -1;
+		float nearestDist = INFINITY;
+		for (int tile = 0; tile < tiles->counts.size(); ++tile) {
+			const float dist = tiles->tileBounds(tile).getCenter().distance(r.first);
+			if (dist < nearestDist && !near.count(tile) && hasWork(tile, r.second)) {
+				nearest = tile;
+				nearestDist = dist;
+			}
+		}
+		if (nearest >= 0) {
+			wanted.insert(nearest);
+		}
+	}
+	keep.insert(wanted.begin(), wanted.end());
+
+	set<int> evict, load;
+	for (int tile : residentTiles) {
+		if (!keep.count(tile)) evict.insert(tile);
+	}
+	for (int tile : wanted) {
+		if (!residentTiles.count(tile)) load.insert(tile);
+	}
+	if (evict.empty() && load.empty()) {
+		return false;
+	}
+
+	if (!evict.empty()) {
+		if (writeBack(evict)) {
+			tiles->saveIndex();
+		}
+		for (auto &p : mapPathStore) {
+			p.second.erase(remove_if(p.second.begin(), p.second.end(), [&](const MapPath &path) {
+				return evict.count(tiles->tileOf(path)) > 0;
+			}), p.second.end());
+		}
+		for (int tile : evict) {
+			residentTiles.erase(tile);
+		}
+	}
+
+	vector<MapPath> loaded;
+	for (int tile : load) {
+		loaded.clear();
+		if (!tiles->readTile(tile, loaded)) continue;
+
+		for (auto &path : loaded) {
+			mapPathStore[path.type].push_back(path);
+		}
+		residentTiles.insert(tile);
+		tileLoads++;
+	}
+	return true;
+}
+
+MapPath* Map::pathById(int id) {
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			if (path.id == id) return &path;
+		}
+	}
+	return NULL;
+}
+
+void Map::resetPaths() {
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			path.claimed = false;
+			path.drawn = false;
+		}
+	}
+	if (!tiles) {
+		return;
+	}
+
+	for (int tile = 0; tile < tiles->counts.size(); ++tile) {
+		if (residentTiles.count(tile)) continue;
+
+		int drawn = 0;
+		for (auto &c : tiles->counts[tile]) {
+			drawn += c.second.drawn;
+		}
+		if (drawn > 0) {
+			tiles->queueUndraw(tile);
+		}
+	}
+	writeBack(residentTiles);
+	tiles->saveIndex();
+}
+
+int Map::residentTileCount() {
+	return residentTiles.size();
+}
+
+int Map::markDrawn(const set<int> &ids) {
+	int marked = 0;
+	for (auto &p : mapPathStore) {
+		for (auto &path : p.second) {
+			if (!path.drawn && ids.count(path.id)) {
+				path.drawn = true;
+				marked++;
+			}
+		}
+	}
+	if (!tiles || ids.empty()) {
+		return marked;
+	}
+
+	// Ids don't say which tile they're in, so every one on disk gets a look
+	const auto shared = make_shared<const set<int>>(ids);
+	for (int tile = 0; tile < tiles->counts.size(); ++tile) {
+		if (residentTiles.count(tile) || tiles->counts[tile].empty()) continue;
+		tiles->queueDrawn(tile, shared);
+	}
+	return marked;
+}
+
+// FNV-1a
+static void hashBytes(uint64_t &hash, const void *data, size_t length) {
+	const uint8_t *bytes = (const uint8_t *)data;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+}
+
+uint64_t Map::fingerprint() {
+	uint64_t hash = 14695981039346656037ULL;
+	for (auto &type : pathTypes) {
+		hashBytes(hash, type.data(), type.size());
+		if (tiles) {
+			// Tiles are summed up rather than read
+			const int total = tiles->totals[type].total;
+			hashBytes(hash, &total, sizeof(total));
+			continue;
+		}
+		for (auto &path : mapPathStore[type]) {
+			const float xy[4] = { path.segment.prescaleStart.x, path.segment.prescaleStart.y, path.segment.prescaleEnd.x, path.segment.prescaleEnd.y };
+			hashBytes(hash, &path.id, sizeof(path.id));
+			hashBytes(hash, xy, sizeof(xy));
+		}
+	}
+	return hash;
+}
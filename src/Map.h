@@ -13,6 +13,11 @@
 #include "ofxXmlSettings.h"
 #include "ofMain.h"
 #include "Util.h"
+#include "SvgPath.h"
+#include "PathSimplifier.h"
+#include "TileStore.h"
+#include "GeoJson.h"
+#include "SegmentClip.h"
 
 typedef struct pathSegment {
 	ofVec2f start, end;
@@ -27,14 +32,43 @@ typedef struct MapPath {
 	pathSegment segment;
 } MapPath;
 
+typedef struct MergeStats {
+	// Covered were simplified differently but lie on drawn segments
+	int kept, covered, added, removed;
+} MergeStats;
+
+// The extent of a map's own coordinates that's stretched over the table
+typedef struct MapFrame {
+	ofVec2f min, max;
+} MapFrame;
+
 class Map {
 public:
 	Map(float widthM, float heightM, float offsetX, float offsetY, ofRectangle cropBox);
-	void loadMap(const string filename);
+	~Map();
+	// SVG, or GeoJSON for .geojson and .json files. Fitted to frame rather
+	// than the map's own extent if there is one.
+	void loadMap(const string filename, const MapFrame *frame = NULL);
 	void rescaleMap(float widthM, float heightM, float offsetX, float offsetY);
     string getMostRecentMap(string path);
+	MapFrame getFrame();
+	// An empty map placed and set up like this one, to load a new version
+	// of it into
+	Map* blankCopy();
+	// Swaps in incoming, a new version of the map loaded into this one's
+	// frame, keeping the progress of segments that are in both. Paths move
+	// and take the new map's ids, renamed maps old ids to new. Only matches
+	// and swaps, incoming can be loaded on another thread. Not for tiled
+	// maps.
+	bool mergeMap(Map &incoming, map<int, int> &renamed, MergeStats &stats);
+	// The drawn segments of each type, and marking drawn whatever lies on
+	// them. A new version is simplified on its own, so its segments can
+	// differ from the drawn ones they're over.
+	void getDrawnSegments(map<string, SegmentBatch> &drawn);
+	int markDrawnOver(const map<string, SegmentBatch> &drawn);
     
-	MapPath* nextPath(const ofVec2f &initial, int robotId, float lastHeading, const set<string> &pathTypes);
+	// Candidates accept turns down are skipped, as if already claimed
+	MapPath* nextPath(const ofVec2f &initial, int robotId, float lastHeading, const set<string> &pathTypes, const function<bool(const MapPath&)> &accept = nullptr);
     
     ofxXmlSettings currentMap;
     
@@ -46,13 +80,57 @@ public:
     void storePath(string type, float startX, float startY, float destX, float destY);
     void clearStore();
     void optimizePaths(float percent);
+
+	// Joins undrawn segments into polylines and drops the points that are
+	// within toleranceM of the rest, path types in parallel
+	SimplifyStats simplifyPaths(float toleranceM);
+	// Used by loadMap after rescaling, 0 keeps every segment
+	float simplifyToleranceM;
+	// GeoJSON feature property holding the path type
+	string pathTypeProperty;
     
     void setPathActive(string path, bool active);
     int getPathCount();
     int getActivePathCount();
     int getDrawnPaths();
     int getPathCount(string type);
+
+	// Very large maps are drawn from tiles on disk, see TileStore.h, with
+	// only the tiles near robots in mapPathStore. Counts cover every tile.
+	bool writeTiles(const string &dir, float tileSizeM);
+	bool openTiles(const string &dir);
+	bool isTiled();
+	// Loads the tiles within marginM of each robot, or the nearest with work
+	// for its types if none of those have any, and writes back and drops
+	// the tiles robots have left. Tiles with claimed paths stay. Returns
+	// true if mapPathStore changed, which moves every MapPath.
+	bool updateResidentTiles(const vector<pair<ofVec2f, set<string>>> &robots, float marginM);
+	// Writes the drawn state of resident tiles to disk, waiting for the
+	// tile I/O thread
+	void flushTiles();
+	// Pen-down length left in tiles that aren't loaded
+	float undrawnOnDisk(const string &type);
+	MapPath* pathById(int id);
+	// Marks every path undrawn and unclaimed, tiles on disk too
+	void resetPaths();
+	// Marks the paths with these ids drawn, tiles on disk too, those from
+	// the tile I/O thread. Returns how many were loaded.
+	int markDrawn(const set<int> &ids);
+	// Changes with the segments loaded, not with their progress
+	uint64_t fingerprint();
+
+	int tileLoads, tileWrites;
+	int residentTileCount();
 private:
+	// Reads the paths of a map without placing them
+	void loadPaths(const string &filename);
+	void loadSvg(const string &filename);
+	void loadGeoJson(const string &filename);
+	void collectPaths(const SvgTransform &parent, const string &lineType, vector<pair<string, SvgPath>> &found);
+	TileCounts typeCounts(const string &type);
+	bool writeBack(const set<int> &tileSet);
+	void closeTiles();
+
 	float widthM, heightM, offsetX, offsetY;
 	float origOffsetX, origOffsetY;
 	float scaleX, scaleY;
@@ -62,6 +140,9 @@ private:
 
 	ofVec2f svgExtentMin, svgExtentMax;
 	ofRectangle cropBox;
+
+	TileStore *tiles;
+	set<int> residentTiles;
 };
 
 #endif
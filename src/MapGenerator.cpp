@@ -0,0 +1,105 @@
+//
+//  MapGenerator.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "MapGenerator.h"
+
+#include <random>
+
+static const char *kTypeNames[] = { "roads", "highways", "water", "rails", "parks", "buildings", "paths", "boundaries" };
+static const int kNumTypeNames = 8;
+
+static string typeName(int i) {
+	return i < kNumTypeNames ? kTypeNames[i] : "type" + ofToString(i);
+}
+
+MapGenerator::MapGenerator(unsigned int s) :
+	width(1000),
+	height(1000),
+	jitter(2),
+	seed(s)
+{}
+
+string MapGenerator::header() {
+	return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg width=\"" + ofToString(width) + "\" height=\"" + ofToString(height) + "\">\n<g id=\"map\">\n";
+}
+
+string MapGenerator::footer() {
+	return "</g>\n</svg>\n";
+}
+
+string MapGenerator::streetGrid(int blocksX, int blocksY, int pathTypes) {
+	mt19937 rng(seed);
+	uniform_real_distribution<float> offset(-jitter, jitter);
+
+	vector<stringstream> groups(pathTypes);
+	const float dx = width / blocksX, dy = height / blocksY;
+
+	// Vertical streets then horizontal streets, one vertex per intersection
+	for (int dir = 0; dir < 2; ++dir) {
+		const int streets = dir == 0 ? blocksX : blocksY;
+		const int blocks = dir == 0 ? blocksY : blocksX;
+
+		for (int i = 0; i <= streets; ++i) {
+			stringstream street;
+			street << "<path d=\"";
+			for (int j = 0; j <= blocks; ++j) {
+				float x = dir == 0 ? i * dx : j * dx;
+				float y = dir == 0 ? j * dy : i * dy;
+				x += offset(rng);
+				y += offset(rng);
+				street << (j == 0 ? "M" : "L") << x << "," << y;
+			}
+			street << "\"/>\n";
+			groups[i % pathTypes] << street.str();
+
+			// Every fourth street is also drawn by the next layer over,
+			// along the same jittered line.
+			if (pathTypes > 1 && i % 4 == 0) {
+				groups[(i + 1) % pathTypes] << street.str();
+			}
+		}
+	}
+
+	string svg = header();
+	for (int t = 0; t < pathTypes; ++t) {
+		svg += "<g id=\"" + typeName(t) + "\">\n" + groups[t].str() + "</g>\n";
+	}
+	return svg + footer();
+}
+
+string MapGenerator::randomLines(int numLines, int pathTypes) {
+	mt19937 rng(seed);
+	uniform_real_distribution<float> x(0, width), y(0, height), angle(0, TWO_PI);
+	exponential_distribution<float> length(1.0 / (width * 0.02));
+
+	vector<stringstream> groups(pathTypes);
+	for (int i = 0; i < numLines; ++i) {
+		const ofVec2f start(x(rng), y(rng));
+		const float a = angle(rng);
+		ofVec2f end = start + ofVec2f(cos(a), sin(a)) * length(rng);
+		end.x = ofClamp(end.x, 0, width);
+		end.y = ofClamp(end.y, 0, height);
+
+		groups[i % pathTypes] << "<path d=\"M" << start.x << "," << start.y << "L" << end.x << "," << end.y << "\"/>\n";
+	}
+
+	string svg = header();
+	for (int t = 0; t < pathTypes; ++t) {
+		svg += "<g id=\"" + typeName(t) + "\">\n" + groups[t].str() + "</g>\n";
+	}
+	return svg + footer();
+}
+
+bool MapGenerator::write(const string &path, const string &svg) {
+	ofstream out(path.c_str());
+	if (!out) {
+		return false;
+	}
+	out << svg;
+	return out.good();
+}
@@ -0,0 +1,38 @@
+//
+//  MapGenerator.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef MapGenerator_h
+#define MapGenerator_h
+
+#include "ofMain.h"
+
+// Synthetic maps in the svg > g > g[id=type] > path layout Map::loadMap reads.
+class MapGenerator {
+public:
+	MapGenerator(unsigned int seed = 1);
+
+	// Jittered street grid, each street a polyline across the map split into
+	// blocks. Streets alternate between pathTypes types and some share edges.
+	string streetGrid(int blocksX, int blocksY, int pathTypes);
+
+	// Independent random lines of varying length.
+	string randomLines(int numLines, int pathTypes);
+
+	static bool write(const string &path, const string &svg);
+
+	float width, height;
+	float jitter;
+
+private:
+	string header();
+	string footer();
+
+	unsigned int seed;
+};
+
+#endif /* MapGenerator_h */
@@ -0,0 +1,118 @@
+//
+//  MapLoader.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "MapLoader.h"
+
+MapLoader::MapLoader() :
+	fingerprint(0),
+	next(NULL),
+	loading(false),
+	loaded(NULL),
+	generation(0),
+	stopping(false)
+{}
+
+MapLoader::~MapLoader() {
+	if (worker.joinable()) {
+		{
+			lock_guard<mutex> l(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+	cancel();
+}
+
+void MapLoader::start(const string &p, Map &current) {
+	Job *job = new Job();
+	job->path = p;
+	job->version = current.blankCopy();
+	job->frame = current.getFrame();
+	current.getDrawnSegments(job->drawn);
+
+	{
+		lock_guard<mutex> l(lock);
+		path = p;
+		job->generation = ++generation;
+		if (next) {
+			delete next->version;
+			delete next;
+		}
+		next = job;
+		delete loaded;
+		loaded = NULL;
+	}
+	if (!worker.joinable()) {
+		worker = thread(&MapLoader::loadLoop, this);
+	}
+	wake.notify_one();
+}
+
+Map* MapLoader::take(bool wait) {
+	unique_lock<mutex> l(lock);
+	if (wait) {
+		done.wait(l, [this]() { return !loading && next == NULL; });
+	}
+	Map *version = loaded;
+	loaded = NULL;
+	return version;
+}
+
+void MapLoader::cancel() {
+	lock_guard<mutex> l(lock);
+	// A load under way is dropped when it finishes
+	generation++;
+	if (next) {
+		delete next->version;
+		delete next;
+		next = NULL;
+	}
+	delete loaded;
+	loaded = NULL;
+}
+
+bool MapLoader::isLoading() {
+	lock_guard<mutex> l(lock);
+	return loading || next != NULL;
+}
+
+bool MapLoader::isReady() {
+	lock_guard<mutex> l(lock);
+	return loaded != NULL;
+}
+
+void MapLoader::loadLoop() {
+	unique_lock<mutex> l(lock);
+	while (true) {
+		wake.wait(l, [this]() { return stopping || next != NULL; });
+		if (stopping) {
+			break;
+		}
+		Job *job = next;
+		next = NULL;
+		loading = true;
+		l.unlock();
+
+		job->version->loadMap(job->path, &job->frame);
+		const int covered = job->version->markDrawnOver(job->drawn);
+		const uint64_t fp = job->version->fingerprint();
+		cout << "Loaded " << job->path << " to merge, " << job->version->getPathCount() << " segments, " << covered << " already drawn" << endl;
+
+		l.lock();
+		loading = false;
+		if (job->generation == generation) {
+			loaded = job->version;
+			fingerprint = fp;
+		} else {
+			delete job->version;
+		}
+		delete job;
+		done.notify_all();
+	}
+}
@@ -0,0 +1,67 @@
+//
+//  MapLoader.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef MapLoader_h
+#define MapLoader_h
+
+#include "ofMain.h"
+#include "Map.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Loads new versions of a map on another thread, fitted to the current
+// version's frame and with what lies on its drawn segments marked drawn, so
+// the control loop only has to match segments and swap. A version asked
+// for while another is loading replaces it once that's done.
+class MapLoader {
+public:
+	MapLoader();
+	~MapLoader();
+
+	// Copies what it needs of current, which can change meanwhile
+	void start(const string &path, Map &current);
+	// The loaded map, which the caller then owns, once the newest version
+	// asked for is ready. NULL while loading unless wait.
+	Map* take(bool wait);
+	// Drops whatever is loading or loaded
+	void cancel();
+	bool isLoading();
+	bool isReady();
+
+	// Of the newest version asked for
+	string path;
+	// Of the loaded map alone, as loadMap into the same frame would have it
+	uint64_t fingerprint;
+
+private:
+	typedef struct Job {
+		string path;
+		Map *version;
+		MapFrame frame;
+		map<string, SegmentBatch> drawn;
+		int generation;
+	} Job;
+
+	void loadLoop();
+
+	thread worker;
+	mutex lock;
+	condition_variable wake, done;
+	// Waiting to start, being loaded and loaded
+	Job *next;
+	bool loading;
+	Map *loaded;
+	// Loads started before the last start or cancel are dropped
+	int generation;
+	bool stopping;
+};
+
+#endif /* MapLoader_h */
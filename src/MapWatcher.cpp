@@ -0,0 +1,154 @@
+//
+//  MapWatcher.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "MapWatcher.h"
+
+#include <regex>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+static const float kPollIntervalSec = 2.0f;
+
+MapWatcher::MapWatcher() :
+	inotifyFd(-1),
+	lastPollTime(-kPollIntervalSec)
+{}
+
+MapWatcher::~MapWatcher() {
+	stop();
+}
+
+bool MapWatcher::mapTimestamp(const string &path, string &timestamp) {
+	static const regex kMapName("maproom-(.{24})\\.svg");
+	smatch m;
+	const string name = ofFilePath::getFileName(path);
+	if (!regex_match(name, m, kMapName)) {
+		return false;
+	}
+	timestamp = m[1];
+	return true;
+}
+
+// A map newer than best and everything before, which becomes best
+bool MapWatcher::newer(const string &name, string &best) {
+	string timestamp;
+	if (!mapTimestamp(name, timestamp) || timestamp <= newestTimestamp || timestamp <= best) {
+		return false;
+	}
+	best = timestamp;
+	return true;
+}
+
+bool MapWatcher::start(const string &d, const string &currentMap) {
+	stop();
+	dir = d;
+
+	// Whatever is there already has been seen
+	newestTimestamp = "";
+	mapTimestamp(currentMap, newestTimestamp);
+	sizes.clear();
+	if (DIR *listing = opendir(dir.c_str())) {
+		while (dirent *entry = readdir(listing)) {
+			string best;
+			if (newer(entry->d_name, best)) {
+				newestTimestamp = best;
+			}
+		}
+		closedir(listing);
+	} else {
+		cout << "Can't watch " << dir << " for maps" << endl;
+		return false;
+	}
+
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0 || inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		cout << "inotify failed on " << dir << ", polling instead" << endl;
+		if (inotifyFd >= 0) {
+			::close(inotifyFd);
+			inotifyFd = -1;
+		}
+	}
+#endif
+	return true;
+}
+
+void MapWatcher::stop() {
+	if (inotifyFd >= 0) {
+		::close(inotifyFd);
+		inotifyFd = -1;
+	}
+	dir = "";
+}
+
+string MapWatcher::poll() {
+	if (dir.empty()) {
+		return "";
+	}
+
+	string best, bestName;
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		// Files are only reported once they're closed or moved into place
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t n;
+		while ((n = read(inotifyFd, buf, sizeof(buf))) > 0) {
+			for (char *p = buf; p < buf + n; p += sizeof(inotify_event) + ((inotify_event *)p)->len) {
+				const inotify_event *event = (const inotify_event *)p;
+				if (event->len > 0 && newer(event->name, best)) {
+					bestName = event->name;
+				}
+			}
+		}
+		if (bestName.empty()) {
+			return "";
+		}
+		newestTimestamp = best;
+		return ofFilePath::join(dir, bestName);
+	}
+#endif
+
+	const float now = ofGetElapsedTimef();
+	if (now - lastPollTime < kPollIntervalSec) {
+		return "";
+	}
+	lastPollTime = now;
+
+	DIR *listing = opendir(dir.c_str());
+	if (!listing) {
+		return "";
+	}
+	map<string, uint64_t> seen;
+	while (dirent *entry = readdir(listing)) {
+		string timestamp;
+		if (!mapTimestamp(entry->d_name, timestamp) || timestamp <= newestTimestamp) continue;
+
+		struct stat st;
+		const string path = ofFilePath::join(dir, entry->d_name);
+		if (stat(path.c_str(), &st) != 0) continue;
+
+		// Still downloading if it grew since last time
+		seen[entry->d_name] = st.st_size;
+		auto last = sizes.find(entry->d_name);
+		if (st.st_size > 0 && last != sizes.end() && last->second == (uint64_t)st.st_size && newer(entry->d_name, best)) {
+			bestName = entry->d_name;
+		}
+	}
+	closedir(listing);
+	sizes.swap(seen);
+
+	if (bestName.empty()) {
+		return "";
+	}
+	newestTimestamp = best;
+	return ofFilePath::join(dir, bestName);
+}
@@ -0,0 +1,45 @@
+//
+//  MapWatcher.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef MapWatcher_h
+#define MapWatcher_h
+
+#include "ofMain.h"
+
+// Notices maproom-<timestamp>.svg files appearing in a directory, such as
+// new map versions landing in Downloads. Uses inotify on Linux and lists
+// the directory every couple of seconds elsewhere.
+class MapWatcher {
+public:
+	MapWatcher();
+	~MapWatcher();
+
+	// Only maps newer than currentMap count, if that's a maproom map
+	bool start(const string &dir, const string &currentMap);
+	void stop();
+
+	// The newest map finished since the last call, "" if none. Never blocks.
+	string poll();
+
+	// The timestamp in a maproom map's file name, false for other files
+	static bool mapTimestamp(const string &path, string &timestamp);
+
+	string dir;
+
+private:
+	bool newer(const string &name, string &best);
+
+	string newestTimestamp;
+	int inotifyFd;
+
+	// Polling: sizes seen last time, a file is finished once it stops growing
+	float lastPollTime;
+	map<string, uint64_t> sizes;
+};
+
+#endif /* MapWatcher_h */
@@ -0,0 +1,151 @@
+//
+//  MetricsServer.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "MetricsServer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// How often the server thread checks whether it should stop
+static const int kAcceptPollMs = 200;
+static const int kClientTimeoutSec = 1;
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+MetricsServer::MetricsServer() :
+	port(0),
+	running(false),
+	listenSocket(-1)
+{}
+
+MetricsServer::~MetricsServer() {
+	stop();
+}
+
+bool MetricsServer::start(int p) {
+	stop();
+
+	listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenSocket < 0) {
+		cout << "Metrics: couldn't create socket" << endl;
+		return false;
+	}
+
+	int yes = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	// Localhost only, metrics are not for the rest of the network
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(p);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (::bind(listenSocket, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenSocket, 4) < 0) {
+		cout << "Metrics: couldn't listen on port " << p << endl;
+		close(listenSocket);
+		listenSocket = -1;
+		return false;
+	}
+
+	port = p;
+	running = true;
+	worker = thread(&MetricsServer::serve, this);
+	cout << "Metrics at http://localhost:" << port << "/metrics" << endl;
+	return true;
+}
+
+void MetricsServer::stop() {
+	if (!running) {
+		return;
+	}
+
+	running = false;
+	worker.join();
+	close(listenSocket);
+	listenSocket = -1;
+}
+
+bool MetricsServer::publish(string &text) {
+	unique_lock<mutex> guard(snapshotLock, try_to_lock);
+	if (!guard.owns_lock()) {
+		return false;
+	}
+
+	snapshot.swap(text);
+	return true;
+}
+
+void MetricsServer::serve() {
+	while (running) {
+		pollfd pfd = { listenSocket, POLLIN, 0 };
+		if (poll(&pfd, 1, kAcceptPollMs) <= 0) {
+			continue;
+		}
+
+		int client = accept(listenSocket, NULL, NULL);
+		if (client < 0) {
+			continue;
+		}
+
+		timeval timeout = { kClientTimeoutSec, 0 };
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+		int yes = 1;
+		setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+		respond(client);
+		close(client);
+	}
+}
+
+void MetricsServer::respond(int client) {
+	// Only the request line matters
+	char request[1024];
+	const int n = recv(client, request, sizeof(request) - 1, 0);
+	if (n <= 0) {
+		return;
+	}
+	request[n] = 0;
+
+	string status = "200 OK";
+	string body;
+	if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+		lock_guard<mutex> guard(snapshotLock);
+		body = snapshot;
+	} else {
+		status = "404 Not Found";
+		body = "Try /metrics\n";
+	}
+
+	stringstream response;
+	response << "HTTP/1.0 " << status << "\r\n"
+		<< "Content-Type: text/plain; version=0.0.4\r\n"
+		<< "Content-Length: " << body.size() << "\r\n"
+		<< "Connection: close\r\n\r\n"
+		<< body;
+
+	const string out = response.str();
+	size_t sent = 0;
+	while (sent < out.size()) {
+		const ssize_t s = send(client, out.data() + sent, out.size() - sent, kSendFlags);
+		if (s <= 0) {
+			return;
+		}
+		sent += s;
+	}
+}
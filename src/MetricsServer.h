@@ -0,0 +1,47 @@
+//
+//  MetricsServer.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef MetricsServer_h
+#define MetricsServer_h
+
+#include "ofMain.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Serves the latest published metrics as plain text over HTTP on
+// localhost, from its own thread. The control loop only ever try-locks
+// to hand over a new snapshot, so a slow or stuck scraper can't stall it.
+class MetricsServer {
+public:
+	MetricsServer();
+	~MetricsServer();
+
+	bool start(int port);
+	void stop();
+
+	// Takes the contents of text. Returns false, leaving text alone, if the
+	// server was busy copying the last snapshot; try again next frame.
+	bool publish(string &text);
+
+	int port;
+
+private:
+	void serve();
+	void respond(int client);
+
+	thread worker;
+	atomic<bool> running;
+	int listenSocket;
+
+	mutex snapshotLock;
+	string snapshot;
+};
+
+#endif /* MetricsServer_h */
@@ -0,0 +1,121 @@
+//
+//  PathSimplifier.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "PathSimplifier.h"
+
+// Ends closer than this are the same point
+static const float kJoinEpsilonM = 0.0001f;
+
+typedef pair<long long, long long> PointKey;
+
+static PointKey pointKey(const ofVec2f &p) {
+	return PointKey(llround(p.x / kJoinEpsilonM), llround(p.y / kJoinEpsilonM));
+}
+
+vector<vector<ofVec2f>> joinSegments(const vector<pair<ofVec2f, ofVec2f>> &segments) {
+	// Segments touching each point, end 0 for start, 1 for end
+	map<PointKey, vector<pair<int, int>>> ends;
+	for (int i = 0; i < segments.size(); ++i) {
+		ends[pointKey(segments[i].first)].push_back(make_pair(i, 0));
+		ends[pointKey(segments[i].second)].push_back(make_pair(i, 1));
+	}
+
+	vector<bool> used(segments.size(), false);
+	vector<vector<ofVec2f>> lines;
+
+	// Walks from the given end of a segment through every point exactly two
+	// segments share
+	auto walk = [&](int first, int fromEnd) {
+		vector<ofVec2f> line;
+		line.push_back(fromEnd == 0 ? segments[first].first : segments[first].second);
+
+		int seg = first, end = fromEnd;
+		while (true) {
+			used[seg] = true;
+			const ofVec2f &next = end == 0 ? segments[seg].second : segments[seg].first;
+			line.push_back(next);
+
+			const vector<pair<int, int>> &touching = ends[pointKey(next)];
+			if (touching.size() != 2) break;
+
+			const pair<int, int> &other = touching[0] == make_pair(seg, 1 - end) ? touching[1] : touching[0];
+			if (used[other.first]) break;
+			seg = other.first;
+			end = other.second;
+		}
+		lines.push_back(line);
+	};
+
+	// Open chains start at their loose ends or junctions
+	for (int i = 0; i < segments.size(); ++i) {
+		if (used[i]) continue;
+		if (ends[pointKey(segments[i].first)].size() != 2) {
+			walk(i, 0);
+		} else if (ends[pointKey(segments[i].second)].size() != 2) {
+			walk(i, 1);
+		}
+	}
+
+	// What's left are closed loops
+	for (int i = 0; i < segments.size(); ++i) {
+		if (!used[i]) {
+			walk(i, 0);
+		}
+	}
+	return lines;
+}
+
+static float pointSegmentDistance(const ofVec2f &p, const ofVec2f &a, const ofVec2f &b) {
+	const ofVec2f ab = b - a;
+	const float lenSq = ab.lengthSquared();
+	if (lenSq < 1e-12) {
+		return p.distance(a);
+	}
+	const float t = ofClamp((p - a).dot(ab) / lenSq, 0, 1);
+	return p.distance(a + ab * t);
+}
+
+vector<ofVec2f> simplifyPolyline(const vector<ofVec2f> &points, float tolerance) {
+	const int n = points.size();
+	if (n < 3) {
+		return points;
+	}
+
+	vector<bool> keep(n, false);
+	keep[0] = keep[n - 1] = true;
+
+	vector<pair<int, int>> spans = { make_pair(0, n - 1) };
+	while (!spans.empty()) {
+		const int a = spans.back().first, b = spans.back().second;
+		spans.pop_back();
+
+		float farthest = 0;
+		int index = -1;
+		for (int i = a + 1; i < b; ++i) {
+			const float d = pointSegmentDistance(points[i], points[a], points[b]);
+			if (d > farthest) {
+				farthest = d;
+				index = i;
+			}
+		}
+
+		if (index >= 0 && farthest > tolerance) {
+			keep[index] = true;
+			spans.push_back(make_pair(a, index));
+			spans.push_back(make_pair(index, b));
+		}
+	}
+
+	vector<ofVec2f> simplified;
+	for (int i = 0; i < n; ++i) {
+		if (keep[i]) {
+			simplified.push_back(points[i]);
+		}
+	}
+	return simplified;
+}
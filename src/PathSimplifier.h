@@ -0,0 +1,27 @@
+//
+//  PathSimplifier.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef PathSimplifier_h
+#define PathSimplifier_h
+
+#include "ofMain.h"
+
+typedef struct SimplifyStats {
+	int before, after;
+} SimplifyStats;
+
+// Chains segments that meet end to end into polylines, as the points they
+// pass through. A chain stops wherever more or fewer than two segments
+// meet, so junctions and loose ends stay where they are.
+vector<vector<ofVec2f>> joinSegments(const vector<pair<ofVec2f, ofVec2f>> &segments);
+
+// Ramer-Douglas-Peucker: keeps the fewest points that leave every dropped
+// one within tolerance of the line through the rest. Ends are always kept.
+vector<ofVec2f> simplifyPolyline(const vector<ofVec2f> &points, float tolerance);
+
+#endif /* PathSimplifier_h */
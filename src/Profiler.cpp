@@ -0,0 +1,142 @@
+//
+//  Profiler.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "Profiler.h"
+
+#include <fstream>
+
+mutex Profiler::lock;
+vector<ProfileStage*> Profiler::all;
+
+static int bucketFor(uint64_t ns) {
+	if (ns < kProfileBucketsPerOctave) {
+		return ns;
+	}
+
+	int octave = 63;
+	while (!(ns >> octave)) {
+		octave--;
+	}
+	// Next two bits below the top one pick the bucket within the octave
+	const int sub = (ns >> (octave - 2)) & (kProfileBucketsPerOctave - 1);
+	return min(octave * kProfileBucketsPerOctave + sub, kProfileBuckets - 1);
+}
+
+// Upper edge of a bucket, so percentiles never read low
+static double bucketUpperNs(int bucket) {
+	if (bucket < kProfileBucketsPerOctave) {
+		return bucket + 1;
+	}
+
+	const int octave = bucket / kProfileBucketsPerOctave;
+	const int sub = bucket % kProfileBucketsPerOctave;
+	return ldexp(kProfileBucketsPerOctave + sub + 1, octave - 2);
+}
+
+ProfileStage::ProfileStage(const string &n) :
+	name(n)
+{
+	reset();
+}
+
+void ProfileStage::add(uint64_t ns) {
+	buckets[bucketFor(ns)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	totalNs.fetch_add(ns, memory_order_relaxed);
+
+	uint64_t prevMax = maxNs.load(memory_order_relaxed);
+	while (ns > prevMax && !maxNs.compare_exchange_weak(prevMax, ns, memory_order_relaxed)) {}
+}
+
+void ProfileStage::reset() {
+	for (int i = 0; i < kProfileBuckets; ++i) {
+		buckets[i] = 0;
+	}
+	count = 0;
+	totalNs = 0;
+	maxNs = 0;
+}
+
+ProfileSummary ProfileStage::summary() {
+	ProfileSummary s;
+	s.count = count.load(memory_order_relaxed);
+	s.maxUs = maxNs.load(memory_order_relaxed) / 1e3;
+	s.meanUs = s.count > 0 ? totalNs.load(memory_order_relaxed) / 1e3 / s.count : 0;
+	s.p50Us = min(percentileUs(0.5, s.count), s.maxUs);
+	s.p99Us = min(percentileUs(0.99, s.count), s.maxUs);
+	return s;
+}
+
+double ProfileStage::percentileUs(double p, uint64_t n) {
+	if (n == 0) {
+		return 0;
+	}
+
+	const uint64_t rank = ceil(p * n);
+	uint64_t seen = 0;
+	for (int i = 0; i < kProfileBuckets; ++i) {
+		seen += buckets[i].load(memory_order_relaxed);
+		if (seen >= rank) {
+			return bucketUpperNs(i) / 1e3;
+		}
+	}
+	return maxNs.load(memory_order_relaxed) / 1e3;
+}
+
+//--------------------------------------------------------------
+
+ProfileStage *Profiler::stage(const string &name) {
+	lock_guard<mutex> guard(lock);
+	for (ProfileStage *s : all) {
+		if (s->name == name) {
+			return s;
+		}
+	}
+
+	ProfileStage *s = new ProfileStage(name);
+	all.push_back(s);
+	return s;
+}
+
+vector<ProfileStage*> Profiler::stages() {
+	lock_guard<mutex> guard(lock);
+	return all;
+}
+
+void Profiler::resetAll() {
+	for (ProfileStage *s : stages()) {
+		s->reset();
+	}
+}
+
+string Profiler::report() {
+	stringstream out;
+	char line[256];
+	snprintf(line, sizeof(line), "%-32s %10s %10s %10s %10s %10s\n", "stage", "count", "mean_us", "p50_us", "p99_us", "max_us");
+	out << line;
+
+	for (ProfileStage *s : stages()) {
+		const ProfileSummary sum = s->summary();
+		snprintf(line, sizeof(line), "%-32s %10llu %10.1f %10.1f %10.1f %10.1f\n", s->name.c_str(),
+				 (unsigned long long)sum.count, sum.meanUs, sum.p50Us, sum.p99Us, sum.maxUs);
+		out << line;
+	}
+	return out.str();
+}
+
+bool Profiler::dump(const string &path) {
+	ofstream file(path);
+	if (!file) {
+		cout << "Couldn't write timings to " << path << endl;
+		return false;
+	}
+
+	file << report();
+	cout << "Wrote timings to " << path << endl;
+	return true;
+}
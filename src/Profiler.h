@@ -0,0 +1,91 @@
+//
+//  Profiler.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#include "ofMain.h"
+#include "Constants.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Four buckets per power of two nanoseconds, about 19% resolution
+static const int kProfileBucketsPerOctave = 4;
+static const int kProfileBuckets = 64 * kProfileBucketsPerOctave;
+
+typedef struct ProfileSummary {
+	uint64_t count;
+	double meanUs, p50Us, p99Us, maxUs;
+} ProfileSummary;
+
+// Latency histogram for one stage. Safe to add to from several threads.
+class ProfileStage {
+public:
+	ProfileStage(const string &name);
+
+	void add(uint64_t ns);
+	void reset();
+	ProfileSummary summary();
+
+	string name;
+
+private:
+	double percentileUs(double p, uint64_t count);
+
+	atomic<uint32_t> buckets[kProfileBuckets];
+	atomic<uint64_t> count, totalNs, maxNs;
+};
+
+// Registry of every stage seen so far. Stages live for the whole run so
+// call sites can keep a pointer to theirs.
+class Profiler {
+public:
+	static ProfileStage *stage(const string &name);
+	static vector<ProfileStage*> stages();
+
+	static void resetAll();
+	static string report();
+	static bool dump(const string &path);
+
+private:
+	static mutex lock;
+	static vector<ProfileStage*> all;
+};
+
+// Times its own lifetime into a stage
+class ProfileScope {
+public:
+	ProfileScope(ProfileStage *s) :
+		stage(s),
+		start(chrono::steady_clock::now())
+	{}
+
+	~ProfileScope() {
+		stage->add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+	}
+
+private:
+	ProfileStage *stage;
+	chrono::steady_clock::time_point start;
+};
+
+// Time the rest of the enclosing scope. The stage is looked up once per
+// call site. Compiles to nothing without PROFILING.
+#if PROFILING
+#define MR_PROFILE_CONCAT_(a, b) a##b
+#define MR_PROFILE_CONCAT(a, b) MR_PROFILE_CONCAT_(a, b)
+#define MR_PROFILE_SCOPE(name) \
+	static ProfileStage *MR_PROFILE_CONCAT(profileStage_, __LINE__) = Profiler::stage(name); \
+	ProfileScope MR_PROFILE_CONCAT(profileScope_, __LINE__)(MR_PROFILE_CONCAT(profileStage_, __LINE__))
+#else
+#define MR_PROFILE_SCOPE(name)
+#endif
+
+#endif /* Profiler_h */
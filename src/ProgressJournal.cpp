@@ -0,0 +1,274 @@
+//
+//  ProgressJournal.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "ProgressJournal.h"
+
+#include <unistd.h>
+
+static const char kJournalMagic[4] = { 'M', 'R', 'J', 'N' };
+static const char kSnapshotMagic[4] = { 'M', 'R', 'S', 'N' };
+static const uint8_t kVersion = 2;
+static const string kJournalName = "journal.bin";
+static const string kSnapshotName = "snapshot.bin";
+
+// How long queued records may wait for the writer
+static const int kFlushIntervalMs = 200;
+// Journal records between snapshots
+static const int kSnapshotRecords = 20000;
+
+static bool readHeader(FILE *file, const char magic[4], uint64_t &fingerprint) {
+	char m[4];
+	uint8_t version = 0;
+	return fread(m, 1, sizeof(m), file) == sizeof(m) && memcmp(m, magic, sizeof(m)) == 0
+		&& fread(&version, 1, 1, file) == 1 && version == kVersion
+		&& fread(&fingerprint, sizeof(fingerprint), 1, file) == 1;
+}
+
+static void writeHeader(FILE *file, const char magic[4], uint64_t fingerprint) {
+	fwrite(magic, 1, 4, file);
+	fwrite(&kVersion, 1, 1, file);
+	fwrite(&fingerprint, sizeof(fingerprint), 1, file);
+}
+
+static bool readFrameFields(FILE *file, MapFrame &frame) {
+	float xy[4];
+	if (fread(xy, sizeof(float), 4, file) != 4) {
+		return false;
+	}
+	frame.min = ofVec2f(xy[0], xy[1]);
+	frame.max = ofVec2f(xy[2], xy[3]);
+	return true;
+}
+
+static void writeFrameFields(FILE *file, const MapFrame &frame) {
+	const float xy[4] = { frame.min.x, frame.min.y, frame.max.x, frame.max.y };
+	fwrite(xy, sizeof(float), 4, file);
+}
+
+ProgressJournal::ProgressJournal() :
+	records(0), snapshots(0),
+	fingerprint(0),
+	file(NULL),
+	stopping(false),
+	sinceSnapshot(0)
+{}
+
+ProgressJournal::~ProgressJournal() {
+	close();
+}
+
+bool ProgressJournal::readSnapshot(const string &path, set<int> &drawnIds) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+
+	uint64_t fp;
+	MapFrame fr;
+	uint32_t count;
+	bool ok = readHeader(f, kSnapshotMagic, fp) && fp == fingerprint && readFrameFields(f, fr) && fread(&count, sizeof(count), 1, f) == 1;
+	if (ok) {
+		vector<int32_t> ids(count);
+		ok = count == 0 || fread(ids.data(), sizeof(int32_t), count, f) == count;
+		if (ok) {
+			drawnIds.insert(ids.begin(), ids.end());
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+bool ProgressJournal::readJournal(const string &path, set<int> &drawnIds) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+
+	uint64_t fp;
+	if (!readHeader(f, kJournalMagic, fp) || fp != fingerprint) {
+		fclose(f);
+		return false;
+	}
+
+	// A record cut short by a crash is the end
+	uint8_t op;
+	int32_t id;
+	int count = 0;
+	while (fread(&op, 1, 1, f) == 1 && fread(&id, sizeof(id), 1, f) == 1 && op < N_JOURNAL_OPS) {
+		if (op == J_DRAWN) {
+			drawnIds.insert(id);
+		} else if (op == J_RESET) {
+			drawnIds.clear();
+		}
+		count++;
+	}
+	fclose(f);
+	cout << "Replayed " << count << " journal records" << endl;
+	return true;
+}
+
+bool ProgressJournal::readFrame(const string &d, uint64_t &fp, MapFrame &fr) {
+	FILE *f = fopen(ofFilePath::join(d, kSnapshotName).c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+	const bool ok = readHeader(f, kSnapshotMagic, fp) && readFrameFields(f, fr);
+	fclose(f);
+	return ok;
+}
+
+bool ProgressJournal::open(const string &d, uint64_t fp, const MapFrame &fr, set<int> &drawnIds) {
+	close();
+
+	if (!ofDirectory::doesDirectoryExist(d, false) && !ofDirectory::createDirectory(d, false, true)) {
+		cout << "Couldn't create journal directory " << d << endl;
+		return false;
+	}
+	dir = d;
+	fingerprint = fp;
+	frame = fr;
+
+	// The journal may repeat what's already in the snapshot if we died
+	// between writing one and starting the other, replaying it is harmless
+	drawn.clear();
+	const bool hadSnapshot = readSnapshot(ofFilePath::join(dir, kSnapshotName), drawn);
+	const bool hadJournal = readJournal(ofFilePath::join(dir, kJournalName), drawn);
+	if (!hadSnapshot && !hadJournal && (ofFile::doesFileExist(ofFilePath::join(dir, kSnapshotName), false) || ofFile::doesFileExist(ofFilePath::join(dir, kJournalName), false))) {
+		cout << "Journal in " << dir << " is for another map, starting over" << endl;
+	}
+	drawnIds = drawn;
+
+	// Start from a compacted snapshot and an empty journal
+	if (!writeSnapshot() || !startJournal()) {
+		return false;
+	}
+
+	records = 0;
+	snapshots = 0;
+	stopping = false;
+	writer = thread(&ProgressJournal::writeLoop, this);
+	return true;
+}
+
+void ProgressJournal::close() {
+	if (!writer.joinable()) {
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(queueLock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+}
+
+bool ProgressJournal::isOpen() {
+	return writer.joinable();
+}
+
+void ProgressJournal::record(JournalOp op, int id) {
+	if (!writer.joinable()) {
+		return;
+	}
+
+	lock_guard<mutex> lock(queueLock);
+	queue.push_back(make_pair((uint8_t)op, (int32_t)id));
+}
+
+bool ProgressJournal::writeSnapshot() {
+	const string path = ofFilePath::join(dir, kSnapshotName), tmpPath = path + ".tmp";
+	FILE *f = fopen(tmpPath.c_str(), "wb");
+	if (!f) {
+		cout << "Couldn't write journal snapshot " << path << endl;
+		return false;
+	}
+
+	writeHeader(f, kSnapshotMagic, fingerprint);
+	writeFrameFields(f, frame);
+	const vector<int32_t> ids(drawn.begin(), drawn.end());
+	const uint32_t count = ids.size();
+	fwrite(&count, sizeof(count), 1, f);
+	bool ok = fwrite(ids.data(), sizeof(int32_t), count, f) == count;
+	ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+	fclose(f);
+
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		cout << "Couldn't write journal snapshot " << path << endl;
+		return false;
+	}
+	sinceSnapshot = 0;
+	snapshots++;
+	return true;
+}
+
+bool ProgressJournal::startJournal() {
+	if (file) {
+		fclose(file);
+	}
+
+	const string path = ofFilePath::join(dir, kJournalName);
+	file = fopen(path.c_str(), "wb");
+	if (!file) {
+		cout << "Couldn't open journal " << path << endl;
+		return false;
+	}
+	writeHeader(file, kJournalMagic, fingerprint);
+	fflush(file);
+	return true;
+}
+
+void ProgressJournal::writeLoop() {
+	vector<pair<uint8_t, int32_t>> batch;
+	vector<char> bytes;
+	bool done = false;
+	while (!done) {
+		{
+			unique_lock<mutex> lock(queueLock);
+			wake.wait_for(lock, chrono::milliseconds(kFlushIntervalMs), [this]() { return stopping; });
+			batch.swap(queue);
+			done = stopping;
+		}
+		if (batch.empty() && !done) {
+			continue;
+		}
+
+		bytes.resize(batch.size() * 5);
+		for (int i = 0; i < batch.size(); ++i) {
+			bytes[i * 5] = batch[i].first;
+			memcpy(&bytes[i * 5 + 1], &batch[i].second, sizeof(int32_t));
+
+			if (batch[i].first == J_DRAWN) {
+				drawn.insert(batch[i].second);
+			} else if (batch[i].first == J_RESET) {
+				drawn.clear();
+			}
+		}
+
+		if (file && !bytes.empty()) {
+			fwrite(bytes.data(), 1, bytes.size(), file);
+			// Survive the machine going down, not just the app
+			fflush(file);
+			fsync(fileno(file));
+		}
+		records += batch.size();
+		sinceSnapshot += batch.size();
+		batch.clear();
+
+		if (sinceSnapshot >= kSnapshotRecords || (done && sinceSnapshot > 0)) {
+			if (writeSnapshot()) {
+				startJournal();
+			}
+		}
+	}
+}
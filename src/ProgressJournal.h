@@ -0,0 +1,81 @@
+//
+//  ProgressJournal.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef ProgressJournal_h
+#define ProgressJournal_h
+
+#include "ofMain.h"
+#include "Map.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef enum JournalOp {
+	J_CLAIMED = 0,
+	J_UNCLAIMED,
+	J_DRAWN,
+	J_RESET,		// every segment undrawn, id unused
+	N_JOURNAL_OPS
+} JournalOp;
+
+// Segment progress for one map, so a restarted coordinator carries on where
+// it stopped. The control loop only queues records; a writer thread appends
+// them to the journal and every so often folds it into a snapshot of the
+// drawn segments and starts the journal over. The snapshot also keeps the
+// frame the map was fitted to, which after a merge is the old version's.
+//   snapshot.bin: "MRSN" uint8 version uint64 map fingerprint, float32[4]
+//     frame min and max, uint32 count, then int32 drawn ids
+//   journal.bin: "MRJN" uint8 version uint64 map fingerprint, then uint8 op
+//     int32 id per record
+// Claims are journaled but not restored, robots plan afresh after a restart.
+class ProgressJournal {
+public:
+	ProgressJournal();
+	~ProgressJournal();
+
+	// Reads back the segments drawn in dir for the map with this fingerprint
+	// and carries on journaling there. Another map's journal is dropped.
+	bool open(const string &dir, uint64_t fingerprint, const MapFrame &frame, set<int> &drawn);
+	// The frame and fingerprint of the map journaled in dir, to load it the
+	// same way again before opening
+	static bool readFrame(const string &dir, uint64_t &fingerprint, MapFrame &frame);
+	// Writes what's queued and a last snapshot
+	void close();
+	bool isOpen();
+
+	// No-op when not open
+	void record(JournalOp op, int id);
+
+	string dir;
+	atomic<int> records, snapshots;
+
+private:
+	bool readSnapshot(const string &path, set<int> &drawnIds);
+	bool readJournal(const string &path, set<int> &drawnIds);
+	bool writeSnapshot();
+	bool startJournal();
+	void writeLoop();
+
+	uint64_t fingerprint;
+	MapFrame frame;
+	FILE *file;
+
+	thread writer;
+	mutex queueLock;
+	condition_variable wake;
+	vector<pair<uint8_t, int32_t>> queue;
+	bool stopping;
+
+	// The writer's copy of the drawn set, for snapshots
+	set<int> drawn;
+	int sinceSnapshot;
+};
+
+#endif /* ProgressJournal_h */
@@ -0,0 +1,83 @@
+//
+//  ReservationTable.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "ReservationTable.h"
+
+ReservationTable::ReservationTable() {
+	configure(0.25);
+}
+
+void ReservationTable::configure(float c) {
+	clearance = c;
+}
+
+void ReservationTable::reserve(int robotId, const vector<Corridor> &corridors) {
+	Reservation &r = reservations[robotId];
+	r.corridors = corridors;
+	r.parked = false;
+}
+
+void ReservationTable::park(int robotId, const ofVec2f &pos, float now) {
+	Reservation &r = reservations[robotId];
+	r.corridors = { { pos, pos, now, INFINITY } };
+	r.parked = true;
+}
+
+void ReservationTable::release(int robotId) {
+	reservations.erase(robotId);
+}
+
+void ReservationTable::clear() {
+	reservations.clear();
+}
+
+int ReservationTable::conflict(int robotId, const vector<Corridor> &corridors, float now, bool ignoreParked) const {
+	for (auto &p : reservations) {
+		if (p.first == robotId || (ignoreParked && p.second.parked)) continue;
+
+		for (const Corridor &held : p.second.corridors) {
+			// Still held past its window means the robot is late, not gone
+			const float heldEnd = max(held.endTime, now);
+
+			for (const Corridor &c : corridors) {
+				if (c.startTime > heldEnd || c.endTime < held.startTime) continue;
+
+				if (segmentDistance(c.start, c.end, held.start, held.end) < clearance) {
+					return p.first;
+				}
+			}
+		}
+	}
+	return -1;
+}
+
+static float pointSegmentDistance(const ofVec2f &p, const ofVec2f &a, const ofVec2f &b) {
+	const ofVec2f ab = b - a;
+	const float lenSq = ab.lengthSquared();
+	if (lenSq < 1e-12) {
+		return p.distance(a);
+	}
+	const float t = ofClamp((p - a).dot(ab) / lenSq, 0, 1);
+	return p.distance(a + ab * t);
+}
+
+static float cross(const ofVec2f &a, const ofVec2f &b) {
+	return a.x * b.y - a.y * b.x;
+}
+
+float ReservationTable::segmentDistance(const ofVec2f &a0, const ofVec2f &a1, const ofVec2f &b0, const ofVec2f &b1) {
+	// Crossing segments touch
+	const float d0 = cross(a1 - a0, b0 - a0), d1 = cross(a1 - a0, b1 - a0);
+	const float d2 = cross(b1 - b0, a0 - b0), d3 = cross(b1 - b0, a1 - b0);
+	if (((d0 > 0 && d1 < 0) || (d0 < 0 && d1 > 0)) && ((d2 > 0 && d3 < 0) || (d2 < 0 && d3 > 0))) {
+		return 0;
+	}
+
+	return min(min(pointSegmentDistance(a0, b0, b1), pointSegmentDistance(a1, b0, b1)),
+			   min(pointSegmentDistance(b0, a0, a1), pointSegmentDistance(b1, a0, a1)));
+}
@@ -0,0 +1,52 @@
+//
+//  ReservationTable.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef ReservationTable_h
+#define ReservationTable_h
+
+#include "ofMain.h"
+
+// Straight stretch a robot will sweep between two times
+typedef struct Corridor {
+	ofVec2f start, end;
+	float startTime, endTime;
+} Corridor;
+
+typedef struct Reservation {
+	vector<Corridor> corridors;
+	// Standing still with nothing claimed, rather than working a segment
+	bool parked;
+} Reservation;
+
+// Space-time reservations of the corridors robots will sweep for their
+// claimed segments. Two corridors conflict if they come closer than the
+// clearance while their time windows overlap. A robot running late keeps
+// its corridors until it releases them.
+class ReservationTable {
+public:
+	ReservationTable();
+
+	// Closest the centre lines of two corridors may come, in m
+	void configure(float clearance);
+
+	void reserve(int robotId, const vector<Corridor> &corridors);
+	// Holds the spot a robot is standing on until it reserves something
+	void park(int robotId, const ofVec2f &pos, float now);
+	void release(int robotId);
+	void clear();
+
+	// Robot whose reservation the corridors would cross, -1 if none
+	int conflict(int robotId, const vector<Corridor> &corridors, float now, bool ignoreParked) const;
+
+	static float segmentDistance(const ofVec2f &a0, const ofVec2f &a1, const ofVec2f &b0, const ofVec2f &b1);
+
+	float clearance;
+	map<int, Reservation> reservations;
+};
+
+#endif /* ReservationTable_h */
@@ -7,16 +7,22 @@
 //
 
 #include "Robot.h"
+#include "Simulator.h"
+#include "RobotSender.h"
+#include "Profiler.h"
 
 static const bool debugging = false;
 
-static const float kPositionTolerance = 0.005f;
 static const float kRotationTolerance = 3.0f;
 
 static const float kHeartbeatTimeoutSec = 2.0f;
 static const float kCameraTimeoutSec = 1.0f;
 
 static const float kCalibrationWaitSec = 0.25f;
+static const float kCalibrationMinStopSec = 0.1f;
+static const float kCalibrationTimeoutSec = 3.0f;
+static const int kCalibrationSends = 3;
+static const float kHeadingStableDeg = 1.0f;
 static const float kAngleWaitSec = 2.0f;
 
 void cmdCalibrateAngle(char *buf, int measured) {
@@ -61,12 +67,16 @@ inline float robotDegToOfRad(const float deg) {
 	return ofDegToRad(deg + 90);
 }
 
-Robot::Robot(int rId, int mId, const string &n) :
+Robot::Robot(int rId, int mId, const string &n, Clock *c) :
 	id(rId),
 	markerId(mId),
 	name(n),
 	state(R_NO_CONN),
+	logging(true),
 	enabled(true),
+	clock(c),
+	simulator(NULL),
+	sender(NULL),
 	planePos(0, 0),
 	avgPlanePos(0, 0),
 	slowAvgPlanePos(0, 0),
@@ -74,6 +84,10 @@ Robot::Robot(int rId, int mId, const string &n) :
 	minSpeed(100),
 	maxSpeed(512),
 	speedRamp(0.1),
+	maxAccel(0.5),
+	maxJerk(5.0),
+	speedUnitsPerMps(2000),
+	lastUpdateTime(-1),
 	planeVel(0, 0),
 	avgPlaneVel(0, 0),
 	targetRot(0),
@@ -83,14 +97,25 @@ Robot::Robot(int rId, int mId, const string &n) :
 	glRot(0),
 	avgGlRot(),
 	stateStartTime(0),
+	calibrationSends(0),
+	segmentsDrawn(0),
+	calibrationStartTime(-1),
+	lastCalibrationSec(0),
+	settleStartTime(-1),
+	avgSettleSec(0.3),
 	lastCameraUpdateTime(-1000),
 	cvFramerate(0),
 	lastHeartbeatTime(-1000),
+	messagesSent(0),
 	targetLineKp(14000),
 	targetLineKi(1700),
 	targetLineKd(0.1),
 	targetLineMaxI(5000),
-	targetLinePID(0,0,0)
+	targetLinePID(0,0,0),
+	lineController(LC_PID),
+	speedScale(1),
+	port(0),
+	lastHeading(0)
 {
 	targetLinePID.setPID(targetLineKp, targetLineKi, targetLineKd);
 	targetLinePID.setMaxIOutput(targetLineMaxI);
@@ -99,27 +124,33 @@ Robot::Robot(int rId, int mId, const string &n) :
 
 void Robot::updatePID(float kp, float ki, float kd, float maxI) {
 	targetLineKp = kp;
-	targetLineKi = kd;
-	targetLineKd = ki;
+	targetLineKi = ki;
+	targetLineKd = kd;
 	targetLineMaxI = maxI;
 
 	targetLinePID.reset();
-	targetLinePID.setPID(kp, kd, ki);
+	targetLinePID.setPID(kp, ki, kd);
 	targetLinePID.setMaxIOutput(targetLineMaxI);
 }
 
-void Robot::setCommunication(const string &rIp, int rPort) {
+void Robot::setCommunication(const string &rIp, int rPort, RobotSender *s) {
 	ip = rIp;
 	port = rPort;
 
-	socket.Create();
-	socket.Connect(ip.c_str(), port);
-	socket.SetNonBlocking(true);
+	if (s->setDestination(id, ip, port)) {
+		sender = s;
+	}
 }
 
 void Robot::sendMessage(const string &message) {
-	socket.Send(message.c_str(), message.length());
+	MR_PROFILE_SCOPE("Robot::sendMessage");
+	if (simulator) {
+		simulator->receive(id, message);
+	} else if (sender) {
+		sender->queue(id, message);
+	}
 	lastMessage = message;
+	messagesSent++;
 }
 
 void Robot::sendHeartbeat() {
@@ -157,6 +188,10 @@ string Robot::positionString() {
 }
 
 string Robot::stateString() {
+	return stateString(state);
+}
+
+string Robot::stateString(RobotState state) {
 	switch(state) {
 		case R_START:
 			return "R_START";
@@ -197,13 +232,13 @@ void Robot::updateCamera(const ofVec2f &imPos, const ofVec2f &imUp) {
 
 	allAvgPlanePos += (newPlanePos - allAvgPlanePos) * 0.5;
 
-	const float now = ofGetElapsedTimef();
+	const float now = clock->now();
 	const float dt = now - lastCameraUpdateTime;
 
 	// Calculate delta velocity first
 	if (dt > 0) {
 		planeVel = (newPlanePos - planePos) / dt;
-		avgPlaneVel += (avgPlaneVel - planeVel) * 0.25;
+		avgPlaneVel += (planeVel - avgPlaneVel) * 0.25;
 	}
 
 	// Update positions and previous averages
@@ -215,36 +250,32 @@ void Robot::updateCamera(const ofVec2f &imPos, const ofVec2f &imUp) {
 	avgGlRot += ofAngleDifferenceRadians(avgGlRot, glRot) * 0.1;
 	avgGlRot = fmod(avgGlRot +  3.1415964 * 2.0, 3.1415964 * 2.0);
 
+	headingConvergence.addSample(rot);
+
 	const float framerate = 1.0 / dt;
 	cvFramerate += (framerate - cvFramerate) * 0.1;
 	lastCameraUpdateTime = now;
 }
 
-void Robot::updateSimulation(float dt) {
-	const float unitsPerSec = 0.2;
-	if (state == R_POSITIONING || state == R_DRAWING) {
-		// TODO: add noise?
-		planePos += (targetPlanePos - startPlanePos).normalize() * dt * unitsPerSec;
-	}
-
-	updateCamera(planePos, upVec);
-}
-
 void Robot::gotHeartbeat() {
-	lastHeartbeatTime = ofGetElapsedTimef();
+	lastHeartbeatTime = clock->now();
 }
 
 bool Robot::commsUp() {
-	if (SIMULATING) {
-		return true;
-	} else {
-		return ofGetElapsedTimef() - lastHeartbeatTime < kHeartbeatTimeoutSec;
+	return clock->now() - lastHeartbeatTime < kHeartbeatTimeoutSec;
+}
+
+float Robot::timeInState(RobotState s) {
+	float t = stateDurations[s];
+	if (s == state) {
+		t += clock->now() - stateStartTime;
 	}
+	return t;
 }
 
 bool Robot::cvDetected() {
     if (debugging) return true;
-	return ofGetElapsedTimef() - lastCameraUpdateTime < kCameraTimeoutSec;
+	return clock->now() - lastCameraUpdateTime < kCameraTimeoutSec;
 }
 
 void Robot::setState(RobotState newState) {
@@ -252,35 +283,87 @@ void Robot::setState(RobotState newState) {
 		return;
 	}
 
-	cout << "Robot " << id << ": " << stateString() << " -> ";
+	const RobotState oldState = state;
+	const float now = clock->now();
+	stateDurations[oldState] += now - stateStartTime;
 	state = newState;
-	cout << stateString() << endl;
+	if (logging) {
+		cout << "Robot " << id << ": " << stateString(oldState) << " -> " << stateString() << endl;
+	}
+
+	stateStartTime = now;
 
-	stateStartTime = ofGetElapsedTimef();
+	if (state == R_WAIT_AFTER_POSITION && settleStartTime < 0) {
+		settleStartTime = stateStartTime;
+	}
+
+	if (state == R_CALIBRATING_ANGLE || state == R_WAITING_ANGLE) {
+		headingConvergence.reset();
+		calibrationSends = 0;
+		if (calibrationStartTime < 0) {
+			calibrationStartTime = stateStartTime;
+		}
+	} else if (state == R_READY_TO_POSITION && oldState == R_WAITING_ANGLE) {
+		lastCalibrationSec = stateStartTime - calibrationStartTime;
+		calibrationStartTime = -1;
+		if (logging) {
+			cout << "Robot " << id << ": calibrated in " << lastCalibrationSec << "s" << endl;
+		}
+	} else if (state == R_NO_CONN || state == R_STOPPED) {
+		calibrationStartTime = -1;
+	}
 }
 
-void Robot::moveRobot(char *msg, bool drawing, bool &shouldSend) {
+void Robot::moveRobot(char *msg, bool drawing, float dt, bool &shouldSend) {
 	// Vectors for movement - ideal and remaining
     const ofVec2f line = targetPlanePos - startPlanePos;
 	ofVec2f currentToEnd = targetPlanePos - planePos;
 
 	// Calculate where and how fast we'd go to just get to the end
 	const float distanceToEnd = currentToEnd.length();
-	float forwardMag = ofMap(distanceToEnd, 0, speedRamp, minSpeed, maxSpeed, true);
+	float forwardMag;
+	if (speedScale <= 0) {
+		// Holding for another robot, start again from standstill and don't
+		// wind up the line correction while standing still
+		forwardMag = 0;
+		speedProfile.reset(0);
+		targetLinePID.reset();
+	} else if (maxAccel > 0) {
+		speedProfile.setLimits(maxAccel, maxJerk);
+		forwardMag = speedProfile.update(dt, distanceToEnd, maxSpeed * speedScale / speedUnitsPerMps, minSpeed * speedScale / speedUnitsPerMps) * speedUnitsPerMps;
+	} else {
+		forwardMag = ofMap(distanceToEnd, 0, speedRamp, minSpeed, maxSpeed, true) * speedScale;
+	}
 	const ofVec2f currentToEndDir = (line.dot(currentToEnd) / line.lengthSquared() * line).normalize();
 	vecToEnd = currentToEndDir * forwardMag;
 
 	// Calculate how far we are from the line and how we should correct for that
 	dirToLine = vecPtToLine(planePos, startPlanePos, targetPlanePos);
-	const float distToLine = dirToLine.length();
-	const double targetLinePIDOutput = targetLinePID.getOutput(distToLine, 0.0);
-	backToLine = targetLinePIDOutput * ofVec2f(dirToLine).normalize() * -1.0;
 
-	// Apply a weighting where the line following is stronger at the start
-	backToLine *= ofMap(distanceToEnd, 0, 0.25, 0.25, 1.0, true);
+	if (lineController == LC_MPC) {
+		// Predict the cross-track error over the horizon and pick the lateral
+		// speed that best brings it to zero, at most 45 degrees off the line.
+		const ofVec2f normal = ofVec2f(-line.y, line.x).normalize();
+		const float crossTrack = (planePos - startPlanePos).dot(normal);
+		const float forwardMps = forwardMag / speedUnitsPerMps;
+		const float lateralMps = lineMPC.solve(crossTrack, forwardMps, dt);
+		backToLine = normal * lateralMps * speedUnitsPerMps;
+
+		movement = vecToEnd + backToLine;
+		if (movement.length() > maxSpeed) {
+			movement.normalize() *= maxSpeed;
+		}
+	} else {
+		const float distToLine = dirToLine.length();
+		const double targetLinePIDOutput = targetLinePID.getOutput(distToLine, 0.0);
+		backToLine = targetLinePIDOutput * ofVec2f(dirToLine).normalize() * -1.0;
 
-	// Combine the two vectors
-	movement = (vecToEnd + backToLine).normalize() * forwardMag;
+		// Apply a weighting where the line following is stronger at the start
+		backToLine *= ofMap(distanceToEnd, 0, 0.25, 0.25, 1.0, true);
+
+		// Combine the two vectors
+		movement = (vecToEnd + backToLine).normalize() * forwardMag;
+	}
 	float angle = ofRadToRobotDeg(atan2(movement.y, movement.x));
 	const float mag = movement.length();
 
@@ -316,6 +399,10 @@ void Robot::navigateTo(const ofVec2f &target) {
 	targetLinePID.setMaxIOutput(0);
 	targetLinePID.setMaxIOutput(targetLineMaxI);
 
+	speedProfile.reset(minSpeed / speedUnitsPerMps);
+	lineMPC.reset();
+
+	settleStartTime = -1;
     setState(R_POSITIONING);
 }
 
@@ -327,16 +414,28 @@ void Robot::drawLine(const ofVec2f &start, const ofVec2f &end) {
 	targetLinePID.setMaxIOutput(0);
 	targetLinePID.setMaxIOutput(targetLineMaxI);
 
+	speedProfile.reset(minSpeed / speedUnitsPerMps);
+	lineMPC.reset();
+
+	if (settleStartTime >= 0) {
+		avgSettleSec += (clock->now() - settleStartTime - avgSettleSec) * 0.25;
+		settleStartTime = -1;
+	}
+
 	setState(R_DRAWING);
 }
 
 void Robot::update() {
+	MR_PROFILE_SCOPE("Robot::update");
 	if (!enabled) {
 		return;
 	}
 
 	bool shouldSend = false, mustSend = false;
-	const float elapsedStateTime = ofGetElapsedTimef() - stateStartTime;
+	const float now = clock->now();
+	const float elapsedStateTime = now - stateStartTime;
+	const float dt = lastUpdateTime < 0 ? 0 : now - lastUpdateTime;
+	lastUpdateTime = now;
 
 	if (!commsUp()) {
 		if (state != R_NO_CONN) {
@@ -365,16 +464,17 @@ void Robot::update() {
         
 		setState(R_CALIBRATING_ANGLE);
 	} else if (state == R_CALIBRATING_ANGLE) {
-		// We're calibrating the angle for a bit
+		// Stop until the heading settles, then send it a few times.
+		const bool stable = headingConvergence.converged(kHeadingStableDeg);
 
-		if (elapsedStateTime < 0.5f) {
-			cmdStop(msg);
-			shouldSend = true;
-		} else if (elapsedStateTime >= 3.0f) {
+		if (calibrationSends >= kCalibrationSends || elapsedStateTime >= kCalibrationTimeoutSec) {
 			// We've calibrated enough
             setState(R_ROTATING_TO_ANGLE);
+		} else if (calibrationSends == 0 && (elapsedStateTime < kCalibrationMinStopSec || !stable)) {
+			cmdStop(msg);
+			shouldSend = true;
 		} else {
-			cmdCalibrateAngle(msg, avgRot);
+			cmdCalibrateAngle(msg, stable ? headingConvergence.meanDeg() : avgRot);
 			shouldSend = true;
 		}
     } else if (state == R_ROTATING_TO_ANGLE) {
@@ -396,12 +496,13 @@ void Robot::update() {
 		}
 	} else if (state == R_WAITING_ANGLE) {
 		// We're waiting after issuing rotate commands
+		const bool stable = headingConvergence.converged(kHeadingStableDeg);
 
-		if (elapsedStateTime > 1.0f && !atRotation()) {
+		if ((stable || elapsedStateTime > 1.0f) && !atRotation()) {
 			// We're out of tolerance, try calibrating again.
 			setState(R_CALIBRATING_ANGLE);
-		} else if (elapsedStateTime > kAngleWaitSec) {
-			// We've waited long enough, let's move on to positioning.
+		} else if (stable || elapsedStateTime > kAngleWaitSec) {
+			// Heading has settled in tolerance, let's move on to positioning.
 			cmdStop(msg, false);
 			shouldSend = true;
 
@@ -419,7 +520,7 @@ void Robot::update() {
             setState(R_WAIT_AFTER_POSITION);
         } else {
             // move is different from draw
-            moveRobot(msg, false, shouldSend);
+            moveRobot(msg, false, dt, shouldSend);
         }
     } else if (state == R_WAIT_AFTER_POSITION) {
         cmdStop(msg);
@@ -443,7 +544,7 @@ void Robot::update() {
 
             setState(R_DONE_DRAWING);
         } else {
-            moveRobot(msg, true, shouldSend);
+            moveRobot(msg, true, dt, shouldSend);
         }
     } else if (state == R_DONE_DRAWING) {
         cmdStop(msg);
@@ -455,8 +556,12 @@ void Robot::update() {
 	}
 
 	// Only send messages every so often to avoid hammering the Arduino.
-	if (mustSend || (shouldSend && ofGetFrameNum() % 4 == 0)) {
+	if (mustSend || (shouldSend && clock->frameNum() % 4 == 0)) {
 		sendMessage(msg);
+
+		if (state == R_CALIBRATING_ANGLE && strncmp(msg, "MRCAL", 5) == 0) {
+			calibrationSends++;
+		}
 	}
 }
 
@@ -10,14 +10,22 @@
 #define Robot_h
 
 #include "ofMain.h"
-#include "ofxUDPManager.h"
 #include "MiniPID.h"
 #include "Constants.h"
+#include "VelocityProfile.h"
+#include "HeadingConvergence.h"
+#include "LineMPC.h"
+#include "Clock.h"
+
+class Simulator;
+class RobotSender;
 
 static const float kMetersPerInch = 0.0254;
 static const float kMarkerSizeIn = 5.0;
 static const float kMarkerSizeM = kMarkerSizeIn * kMetersPerInch;
 
+static const float kPositionTolerance = 0.005f;
+
 typedef enum RobotState {
 	R_NO_CONN,
 	R_START,
@@ -33,6 +41,11 @@ typedef enum RobotState {
 	R_STOPPED
 } RobotState;
 
+typedef enum LineController {
+	LC_PID,
+	LC_MPC
+} LineController;
+
 typedef enum PenState {
 	P_UNKNOWN,
 	P_UP,
@@ -42,10 +55,11 @@ typedef enum PenState {
 class Robot {
 
 public:
-	Robot(int rId, int mId, const string &n);
+	Robot(int rId, int mId, const string &n, Clock *c = Clock::real());
 
-	// Setup communication - must be called before sending any messages
-	void setCommunication(const string &rIp, int rPort);
+	// Setup communication - must be called before sending any messages.
+	// Messages go out on the next sender flush.
+	void setCommunication(const string &rIp, int rPort, RobotSender *s);
 	void sendMessage(const string &message);
 	void sendHeartbeat();
 	void gotHeartbeat();
@@ -53,23 +67,22 @@ public:
 	// Update from CV
 	void updateCamera(const ofVec2f &imPos, const ofVec2f &imUp);
 
-	// Update simulation
-	void updateSimulation(float dt);
-
 	// Update during loop
 	void update();
 	void setState(RobotState newState);
 	void updatePID(float kp, float ki, float kd, float maxI);
 
 	// States
-	void moveRobot(char *msg, bool drawing, bool &shouldSend);
+	void moveRobot(char *msg, bool drawing, float dt, bool &shouldSend);
     bool inPosition(const ofVec2f &pos);
 	bool atRotation();
 
 	// Query robot state
 	bool commsUp();
+	float timeInState(RobotState s);
 	bool cvDetected();
 	string stateString();
+	static string stateString(RobotState state);
 	string stateDescription();
 	string positionString();
 
@@ -98,27 +111,56 @@ public:
 	int id;
 	string name;
 	int markerId;
+	Clock *clock;
     
 	// State machine
 	RobotState state;
+	bool logging;
 	float stateStartTime;
 
+	// Calibration - finishes once the heading estimate settles
+	HeadingConvergence headingConvergence;
+	int calibrationSends;
+	float calibrationStartTime, lastCalibrationSec;
+
+	// Job statistics
+	map<RobotState, float> stateDurations;
+	int segmentsDrawn;
+
+	// Time spent settling after positioning, skipped by continuing segments
+	float settleStartTime, avgSettleSec;
+
 	// Targets
 	float targetRot;
 	ofVec2f startPlanePos, targetPlanePos;
 
 	// PID
 	float minSpeed, maxSpeed, speedRamp;
+
+	// Speed planning - accel in m/s^2, jerk in m/s^3, maxAccel <= 0 falls back to speedRamp
+	float maxAccel, maxJerk;
+	float speedUnitsPerMps;
+	VelocityProfile speedProfile;
+	float lastUpdateTime;
 	MiniPID targetLinePID;
 	float targetLineKp, targetLineKi, targetLineKd, targetLineMaxI;
 
+	// Alternative line follower
+	LineController lineController;
+	LineMPC lineMPC;
+
+	// Set by collision avoidance each frame, 1 full speed, 0 hold position
+	float speedScale;
+
 	// Communication
 	bool enabled;
 	string ip;
 	int port;
-	ofxUDPManager socket;
+	Simulator *simulator;
+	RobotSender *sender;
 	string lastMessage;
 	float lastHeartbeatTime;
+	int messagesSent;
 	char msg[128];
 
 	// Received from CV
@@ -0,0 +1,130 @@
+//
+//  RobotSender.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "RobotSender.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Messages per sendmmsg call
+static const int kBatchSize = 64;
+
+RobotSender::RobotSender() :
+	messagesSent(0),
+	sendCalls(0),
+	sendErrors(0),
+	fd(-1)
+{}
+
+RobotSender::~RobotSender() {
+	close();
+}
+
+bool RobotSender::open() {
+	close();
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		cout << "RobotSender: couldn't create socket" << endl;
+		return false;
+	}
+
+	// A robot that's off the network mustn't stall the control loop
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	return true;
+}
+
+void RobotSender::close() {
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+	pending.clear();
+}
+
+bool RobotSender::setDestination(int robotId, const string &ip, int port) {
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+		cout << "RobotSender: bad address " << ip << " for robot " << robotId << endl;
+		return false;
+	}
+
+	destinations[robotId] = addr;
+	return true;
+}
+
+bool RobotSender::hasDestination(int robotId) const {
+	return destinations.find(robotId) != destinations.end();
+}
+
+void RobotSender::queue(int robotId, const string &message) {
+	if (hasDestination(robotId)) {
+		pending.push_back(make_pair(robotId, message));
+	}
+}
+
+int RobotSender::flush() {
+	if (pending.empty()) {
+		return 0;
+	}
+	if (fd < 0) {
+		pending.clear();
+		return 0;
+	}
+
+	int sent = 0;
+#ifdef __linux__
+	mmsghdr msgs[kBatchSize];
+	iovec iovs[kBatchSize];
+
+	for (int first = 0; first < pending.size(); ) {
+		const int count = min((int)pending.size() - first, kBatchSize);
+		memset(msgs, 0, sizeof(msgs[0]) * count);
+		for (int i = 0; i < count; ++i) {
+			string &message = pending[first + i].second;
+			iovs[i].iov_base = (void *)message.data();
+			iovs[i].iov_len = message.size();
+			msgs[i].msg_hdr.msg_name = &destinations[pending[first + i].first];
+			msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		// Stops at the first message the kernel won't take; drop that one
+		// and carry on with the rest
+		const int n = max((int)sendmmsg(fd, msgs, count, 0), 0);
+		sendCalls++;
+		sent += n;
+		first += n;
+		if (n < count) {
+			sendErrors++;
+			first++;
+		}
+	}
+#else
+	for (auto &p : pending) {
+		const sockaddr_in &addr = destinations[p.first];
+		sendCalls++;
+		if (sendto(fd, p.second.data(), p.second.size(), 0, (const sockaddr *)&addr, sizeof(addr)) < 0) {
+			sendErrors++;
+		} else {
+			sent++;
+		}
+	}
+#endif
+
+	pending.clear();
+	messagesSent += sent;
+	return sent;
+}
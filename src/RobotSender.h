@@ -0,0 +1,45 @@
+//
+//  RobotSender.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef RobotSender_h
+#define RobotSender_h
+
+#include "ofMain.h"
+
+#include <netinet/in.h>
+
+// One unconnected UDP socket for every robot. Messages are queued during a
+// tick and flushed together, in a single sendmmsg where the platform has
+// it, one sendto per message otherwise.
+class RobotSender {
+public:
+	RobotSender();
+	~RobotSender();
+
+	bool open();
+	void close();
+
+	// False if ip isn't a dotted IPv4 address
+	bool setDestination(int robotId, const string &ip, int port);
+	bool hasDestination(int robotId) const;
+
+	// Dropped if the robot has no destination
+	void queue(int robotId, const string &message);
+
+	// Returns the number of messages handed to the kernel
+	int flush();
+
+	int messagesSent, sendCalls, sendErrors;
+
+private:
+	int fd;
+	map<int, sockaddr_in> destinations;
+	vector<pair<int, string>> pending;
+};
+
+#endif /* RobotSender_h */
@@ -0,0 +1,152 @@
+//
+//  SegmentClip.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "SegmentClip.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+static const int kLanes = 8;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+static const int kLanes = 4;
+#else
+static const int kLanes = 1;
+#endif
+
+void SegmentBatch::push(const ofVec2f &start, const ofVec2f &end) {
+	x0.push_back(start.x);
+	y0.push_back(start.y);
+	x1.push_back(end.x);
+	y1.push_back(end.y);
+}
+
+ofVec2f SegmentBatch::start(int i) const {
+	return ofVec2f(x0[i], y0[i]);
+}
+
+ofVec2f SegmentBatch::end(int i) const {
+	return ofVec2f(x1[i], y1[i]);
+}
+
+int SegmentBatch::size() const {
+	return x0.size();
+}
+
+void SegmentBatch::clear() {
+	x0.clear();
+	y0.clear();
+	x1.clear();
+	y1.clear();
+}
+
+// Bit i of outside is set if segment first + i has an end outside rect,
+// of reject if both ends are past the same edge
+static void classifyScalar(const SegmentBatch &b, int first, int lanes, float minX, float minY, float maxX, float maxY, int &outside, int &reject) {
+	outside = reject = 0;
+	for (int i = 0; i < lanes; ++i) {
+		const float x0 = b.x0[first + i], y0 = b.y0[first + i];
+		const float x1 = b.x1[first + i], y1 = b.y1[first + i];
+		if (x0 < minX || x1 < minX || x0 > maxX || x1 > maxX || y0 < minY || y1 < minY || y0 > maxY || y1 > maxY) {
+			outside |= 1 << i;
+		}
+		if ((x0 < minX && x1 < minX) || (x0 > maxX && x1 > maxX) || (y0 < minY && y1 < minY) || (y0 > maxY && y1 > maxY)) {
+			reject |= 1 << i;
+		}
+	}
+}
+
+// The same for a full set of lanes
+static void classify(const SegmentBatch &b, int first, float minX, float minY, float maxX, float maxY, int &outside, int &reject) {
+#if defined(__AVX__)
+	const __m256 lx = _mm256_set1_ps(minX), ly = _mm256_set1_ps(minY), hx = _mm256_set1_ps(maxX), hy = _mm256_set1_ps(maxY);
+	const __m256 x0 = _mm256_loadu_ps(&b.x0[first]), y0 = _mm256_loadu_ps(&b.y0[first]);
+	const __m256 x1 = _mm256_loadu_ps(&b.x1[first]), y1 = _mm256_loadu_ps(&b.y1[first]);
+
+	const __m256 left0 = _mm256_cmp_ps(x0, lx, _CMP_LT_OQ), left1 = _mm256_cmp_ps(x1, lx, _CMP_LT_OQ);
+	const __m256 right0 = _mm256_cmp_ps(x0, hx, _CMP_GT_OQ), right1 = _mm256_cmp_ps(x1, hx, _CMP_GT_OQ);
+	const __m256 top0 = _mm256_cmp_ps(y0, ly, _CMP_LT_OQ), top1 = _mm256_cmp_ps(y1, ly, _CMP_LT_OQ);
+	const __m256 bottom0 = _mm256_cmp_ps(y0, hy, _CMP_GT_OQ), bottom1 = _mm256_cmp_ps(y1, hy, _CMP_GT_OQ);
+
+	const __m256 any = _mm256_or_ps(_mm256_or_ps(_mm256_or_ps(left0, left1), _mm256_or_ps(right0, right1)),
+									_mm256_or_ps(_mm256_or_ps(top0, top1), _mm256_or_ps(bottom0, bottom1)));
+	const __m256 both = _mm256_or_ps(_mm256_or_ps(_mm256_and_ps(left0, left1), _mm256_and_ps(right0, right1)),
+									 _mm256_or_ps(_mm256_and_ps(top0, top1), _mm256_and_ps(bottom0, bottom1)));
+	outside = _mm256_movemask_ps(any);
+	reject = _mm256_movemask_ps(both);
+#elif defined(__SSE2__)
+	const __m128 lx = _mm_set1_ps(minX), ly = _mm_set1_ps(minY), hx = _mm_set1_ps(maxX), hy = _mm_set1_ps(maxY);
+	const __m128 x0 = _mm_loadu_ps(&b.x0[first]), y0 = _mm_loadu_ps(&b.y0[first]);
+	const __m128 x1 = _mm_loadu_ps(&b.x1[first]), y1 = _mm_loadu_ps(&b.y1[first]);
+
+	const __m128 left0 = _mm_cmplt_ps(x0, lx), left1 = _mm_cmplt_ps(x1, lx);
+	const __m128 right0 = _mm_cmpgt_ps(x0, hx), right1 = _mm_cmpgt_ps(x1, hx);
+	const __m128 top0 = _mm_cmplt_ps(y0, ly), top1 = _mm_cmplt_ps(y1, ly);
+	const __m128 bottom0 = _mm_cmpgt_ps(y0, hy), bottom1 = _mm_cmpgt_ps(y1, hy);
+
+	const __m128 any = _mm_or_ps(_mm_or_ps(_mm_or_ps(left0, left1), _mm_or_ps(right0, right1)),
+								 _mm_or_ps(_mm_or_ps(top0, top1), _mm_or_ps(bottom0, bottom1)));
+	const __m128 both = _mm_or_ps(_mm_or_ps(_mm_and_ps(left0, left1), _mm_and_ps(right0, right1)),
+								  _mm_or_ps(_mm_and_ps(top0, top1), _mm_and_ps(bottom0, bottom1)));
+	outside = _mm_movemask_ps(any);
+	reject = _mm_movemask_ps(both);
+#else
+	classifyScalar(b, first, kLanes, minX, minY, maxX, maxY, outside, reject);
+#endif
+}
+
+ClipStats clipSegments(SegmentBatch &batch, const ofRectangle &rect, vector<uint8_t> &keep) {
+	ClipStats stats = { 0, 0, 0 };
+	const int n = batch.size();
+	keep.assign(n, 1);
+
+	const ofVec2f tl = rect.getTopLeft(), br = rect.getBottomRight();
+	const float minX = tl.x - kClipSlack, minY = tl.y - kClipSlack;
+	const float maxX = br.x + kClipSlack, maxY = br.y + kClipSlack;
+
+	for (int first = 0; first < n; first += kLanes) {
+		int outside, reject;
+		const int lanes = min(kLanes, n - first);
+		if (lanes == kLanes) {
+			classify(batch, first, minX, minY, maxX, maxY, outside, reject);
+		} else {
+			classifyScalar(batch, first, lanes, minX, minY, maxX, maxY, outside, reject);
+		}
+
+		if (!outside) {
+			stats.inside += lanes;
+			continue;
+		}
+
+		for (int i = 0; i < lanes; ++i) {
+			const int bit = 1 << i;
+			if (!(outside & bit)) {
+				stats.inside++;
+				continue;
+			}
+			if (reject & bit) {
+				keep[first + i] = 0;
+				stats.outside++;
+				continue;
+			}
+
+			const int s = first + i;
+			ofVec2f start = batch.start(s), end = batch.end(s);
+			keep[s] = CohenSutherlandLineClip(start, end, rect);
+			batch.x0[s] = start.x;
+			batch.y0[s] = start.y;
+			batch.x1[s] = end.x;
+			batch.y1[s] = end.y;
+			if (keep[s]) {
+				stats.clipped++;
+			} else {
+				stats.outside++;
+			}
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,37 @@
+//
+//  SegmentClip.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef SegmentClip_h
+#define SegmentClip_h
+
+#include "ofMain.h"
+#include "Util.h"
+
+// Segments with each coordinate in its own array, so outcodes for a run of
+// them come from a few vector compares
+typedef struct SegmentBatch {
+	vector<float> x0, y0, x1, y1;
+
+	void push(const ofVec2f &start, const ofVec2f &end);
+	ofVec2f start(int i) const;
+	ofVec2f end(int i) const;
+	int size() const;
+	void clear();
+} SegmentBatch;
+
+typedef struct ClipStats {
+	int inside, outside, clipped;
+} ClipStats;
+
+// Clips every segment to rect in place, with the same slack as
+// ComputeOutCode. keep[i] is 0 for segments that miss rect. Only segments
+// crossing an edge go through CohenSutherlandLineClip, the rest are
+// accepted or rejected with SSE or AVX where the compiler has them.
+ClipStats clipSegments(SegmentBatch &batch, const ofRectangle &rect, vector<uint8_t> &keep);
+
+#endif /* SegmentClip_h */
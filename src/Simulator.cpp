@@ -0,0 +1,210 @@
+//
+//  Simulator.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "Simulator.h"
+
+SimConfig defaultSimConfig() {
+	SimConfig c;
+	c.speedUnitsPerMps = 2000;
+	c.velocityLagSec = 0.02;
+	c.deadbandSpeed = 0.02;
+	c.rotationDps = 90;
+	c.commandTimeoutSec = 0.5;
+
+	c.cameraFps = 30;
+	c.cameraLatencySec = 0.05;
+	c.positionNoiseM = 0.0005;
+	c.headingNoiseDeg = 0.3;
+	c.dropoutsPerSec = 0.05;
+	c.dropoutSec = 0.2;
+
+	c.packetLoss = 0.01;
+	c.heartbeatSec = 0.5;
+	return c;
+}
+
+// Robot degrees are clockwise from +y, see ofRadToRobotDeg in Robot.cpp.
+static float robotDegToGlRad(float deg) {
+	return ofDegToRad(90 - deg);
+}
+
+Simulator::Simulator(const SimConfig &c, unsigned int seed) :
+	config(c),
+	time(0),
+	nextFrameTime(0),
+	rng(seed),
+	uniform(0, 1),
+	gaussian(0, 1)
+{}
+
+void Simulator::addRobot(int robotId, int markerId, const ofVec2f &pos, float robotDeg) {
+	SimRobot r;
+	r.id = robotId;
+	r.markerId = markerId;
+	r.pos = pos;
+	r.vel.set(0, 0);
+	r.glRot = robotDegToGlRad(robotDeg);
+	r.penDown = false;
+	r.commandVel.set(0, 0);
+	r.rotating = false;
+	r.targetGlRot = r.glRot;
+	r.lastCommandTime = -1000;
+	r.dropoutUntil = -1;
+	r.nextHeartbeatTime = time;
+	r.penDownDistance = 0;
+	r.penUpDistance = 0;
+	r.commandsReceived = 0;
+	r.commandsDropped = 0;
+	robots[robotId] = r;
+}
+
+float Simulator::now() {
+	return time;
+}
+
+void Simulator::receive(int robotId, const string &message) {
+	if (robots.find(robotId) == robots.end()) {
+		return;
+	}
+
+	SimRobot &r = robots[robotId];
+	if (uniform(rng) < config.packetLoss) {
+		r.commandsDropped++;
+		return;
+	}
+	r.commandsReceived++;
+
+	const char *msg = message.c_str();
+	int angle = 0, magnitude = 0, measured = 0, target = 0, penDown = 0;
+
+	if (sscanf(msg, "MRMOV%d%d%d", &angle, &magnitude, &measured) == 3 ||
+		sscanf(msg, "MRDRW%d%d%d", &angle, &magnitude, &measured) == 3) {
+		const float rad = robotDegToGlRad(angle);
+		r.commandVel = ofVec2f(cos(rad), sin(rad)) * (magnitude / config.speedUnitsPerMps);
+		if (r.commandVel.length() < config.deadbandSpeed) {
+			r.commandVel.set(0, 0);
+		}
+		r.penDown = msg[2] == 'D';
+		r.rotating = false;
+	} else if (sscanf(msg, "MRROT%d%d", &target, &measured) == 2) {
+		r.commandVel.set(0, 0);
+		r.rotating = true;
+		r.targetGlRot = robotDegToGlRad(target);
+		r.penDown = false;
+	} else if (sscanf(msg, "MRSTP%d", &penDown) == 1) {
+		r.commandVel.set(0, 0);
+		r.rotating = false;
+		r.penDown = penDown != 0;
+	} else if (strncmp(msg, "MRCAL", 5) == 0) {
+		r.commandVel.set(0, 0);
+		r.rotating = false;
+	} else if (strncmp(msg, "MRHB", 4) == 0) {
+		// Nothing to do, the heartbeat reply is on a timer.
+	} else {
+		return;
+	}
+
+	r.lastCommandTime = time;
+}
+
+void Simulator::step(float dt) {
+	const float lag = min(1.0f, dt / config.velocityLagSec);
+
+	for (auto &p : robots) {
+		SimRobot &r = p.second;
+
+		// Firmware stops if the coordinator goes quiet.
+		if (time - r.lastCommandTime > config.commandTimeoutSec) {
+			r.commandVel.set(0, 0);
+			r.rotating = false;
+		}
+
+		if (r.rotating) {
+			const float diff = ofAngleDifferenceRadians(r.glRot, r.targetGlRot);
+			const float maxStep = ofDegToRad(config.rotationDps) * dt;
+			r.glRot += ofClamp(diff, -maxStep, maxStep);
+		}
+
+		r.vel += (r.commandVel - r.vel) * lag;
+		const ofVec2f delta = r.vel * dt;
+		r.pos += delta;
+
+		if (r.penDown) {
+			r.penDownDistance += delta.length();
+		} else {
+			r.penUpDistance += delta.length();
+		}
+
+		if (time >= r.nextHeartbeatTime) {
+			r.nextHeartbeatTime = time + config.heartbeatSec;
+			if (uniform(rng) >= config.packetLoss) {
+				char buf[16];
+				sprintf(buf, "RB%02dHB", r.id);
+				robotMessages.push_back(buf);
+			}
+		}
+
+		if (time >= r.dropoutUntil && uniform(rng) < config.dropoutsPerSec * dt) {
+			r.dropoutUntil = time - log(max(1e-6f, uniform(rng))) * config.dropoutSec;
+		}
+	}
+
+	time += dt;
+
+	while (time >= nextFrameTime) {
+		captureFrame();
+		nextFrameTime += 1.0 / config.cameraFps;
+	}
+}
+
+void Simulator::captureFrame() {
+	stringstream ids, pos, up;
+	bool first = true;
+
+	for (auto &p : robots) {
+		SimRobot &r = p.second;
+		if (time < r.dropoutUntil) {
+			continue;
+		}
+
+		const ofVec2f noisyPos = r.pos + ofVec2f(gaussian(rng), gaussian(rng)) * config.positionNoiseM;
+		const float noisyRot = r.glRot + ofDegToRad(gaussian(rng) * config.headingNoiseDeg);
+
+		if (!first) {
+			ids << ",";
+			pos << ",";
+			up << ",";
+		}
+		first = false;
+
+		ids << r.markerId;
+		pos << "[" << noisyPos.x << "," << noisyPos.y << "]";
+		up << "[" << cos(noisyRot) << "," << sin(noisyRot) << "]";
+	}
+
+	SimCameraFrame frame;
+	frame.deliverTime = time + config.cameraLatencySec;
+	frame.json = "{\"ids\":[" + ids.str() + "],\"pos\":[" + pos.str() + "],\"up\":[" + up.str()
+		+ "],\"raw_pos\":[" + pos.str() + "],\"raw_up\":[" + up.str() + "]}";
+	pendingFrames.push_back(frame);
+}
+
+vector<string> Simulator::takeCameraMessages() {
+	vector<string> due;
+	while (!pendingFrames.empty() && pendingFrames.front().deliverTime <= time) {
+		due.push_back(pendingFrames.front().json);
+		pendingFrames.pop_front();
+	}
+	return due;
+}
+
+vector<string> Simulator::takeRobotMessages() {
+	vector<string> due;
+	due.swap(robotMessages);
+	return due;
+}
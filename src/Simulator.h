@@ -0,0 +1,100 @@
+//
+//  Simulator.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef Simulator_h
+#define Simulator_h
+
+#include "ofMain.h"
+
+#include <random>
+
+typedef struct SimConfig {
+	// Plant
+	float speedUnitsPerMps;
+	float velocityLagSec;
+	float deadbandSpeed;
+	float rotationDps;
+	float commandTimeoutSec;
+
+	// Camera
+	float cameraFps;
+	float cameraLatencySec;
+	float positionNoiseM, headingNoiseDeg;
+	float dropoutsPerSec, dropoutSec;
+
+	// Network
+	float packetLoss;
+	float heartbeatSec;
+} SimConfig;
+
+SimConfig defaultSimConfig();
+
+typedef struct SimRobot {
+	int id, markerId;
+
+	// True state
+	ofVec2f pos, vel;
+	float glRot;
+	bool penDown;
+
+	// Last command
+	ofVec2f commandVel;
+	bool rotating;
+	float targetGlRot;
+	float lastCommandTime;
+
+	// Camera and comms
+	float dropoutUntil;
+	float nextHeartbeatTime;
+
+	// Stats
+	float penDownDistance, penUpDistance;
+	int commandsReceived, commandsDropped;
+} SimRobot;
+
+typedef struct SimCameraFrame {
+	float deliverTime;
+	string json;
+} SimCameraFrame;
+
+// Plant model for a fleet of robots. Decodes the commands the coordinator
+// sends, integrates each robot's motion and produces the /cv frames and
+// heartbeats the real camera and robots would. step() is pure computation
+// so it can run as fast as the caller likes.
+class Simulator {
+public:
+	Simulator(const SimConfig &config, unsigned int seed = 1);
+
+	void addRobot(int robotId, int markerId, const ofVec2f &pos, float robotDeg);
+
+	// From the coordinator
+	void receive(int robotId, const string &message);
+
+	void step(float dt);
+	float now();
+
+	// To the coordinator - /cv JSON payloads and robot UDP datagrams now due
+	vector<string> takeCameraMessages();
+	vector<string> takeRobotMessages();
+
+	SimConfig config;
+	map<int, SimRobot> robots;
+
+private:
+	void captureFrame();
+
+	float time, nextFrameTime;
+	deque<SimCameraFrame> pendingFrames;
+	vector<string> robotMessages;
+
+	mt19937 rng;
+	uniform_real_distribution<float> uniform;
+	normal_distribution<float> gaussian;
+};
+
+#endif /* Simulator_h */
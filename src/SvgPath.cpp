@@ -0,0 +1,354 @@
+//
+//  SvgPath.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "SvgPath.h"
+
+// Limits for curves far bigger than the tolerance, or degenerate ones
+static const int kMaxFlattenPieces = 1024;
+static const int kMaxFlattenDepth = 8;
+
+// Numbers, flags and separators out of path data or a transform list
+struct SvgScanner {
+	const string &s;
+	size_t i;
+
+	SvgScanner(const string &str) : s(str), i(0) {}
+
+	void skipSeparators() {
+		while (i < s.size() && (isspace(s[i]) || s[i] == ',')) i++;
+	}
+
+	bool done() {
+		skipSeparators();
+		return i >= s.size();
+	}
+
+	bool atNumber() {
+		skipSeparators();
+		return i < s.size() && (isdigit(s[i]) || s[i] == '.' || s[i] == '-' || s[i] == '+');
+	}
+
+	bool number(float &value) {
+		if (!atNumber()) return false;
+
+		// strtof stops at a second '.', so "0.5.5" is 0.5 then .5
+		const char *start = s.c_str() + i;
+		char *end;
+		value = strtof(start, &end);
+		if (end == start) return false;
+		i += end - start;
+		return true;
+	}
+
+	bool point(ofVec2f &p) {
+		return number(p.x) && number(p.y);
+	}
+
+	// Arc flags are one digit and may run into the next number, "a5 5 0 11 3 4"
+	bool flag(bool &value) {
+		skipSeparators();
+		if (i >= s.size() || (s[i] != '0' && s[i] != '1')) return false;
+		value = s[i++] == '1';
+		return true;
+	}
+};
+
+ofVec2f SvgTransform::apply(const ofVec2f &p) const {
+	return ofVec2f(a * p.x + c * p.y + e, b * p.x + d * p.y + f);
+}
+
+SvgTransform SvgTransform::operator*(const SvgTransform &o) const {
+	return {
+		a * o.a + c * o.b, b * o.a + d * o.b,
+		a * o.c + c * o.d, b * o.c + d * o.d,
+		a * o.e + c * o.f + e, b * o.e + d * o.f + f
+	};
+}
+
+SvgTransform SvgTransform::identity() {
+	return { 1, 0, 0, 1, 0, 0 };
+}
+
+SvgTransform SvgTransform::parse(const string &attribute) {
+	SvgTransform result = identity();
+
+	size_t pos = 0;
+	while (true) {
+		const size_t open = attribute.find('(', pos);
+		const size_t close = attribute.find(')', open);
+		if (open == string::npos || close == string::npos) break;
+
+		string name = attribute.substr(pos, open - pos);
+		name.erase(remove_if(name.begin(), name.end(), [](char ch) { return isspace(ch) || ch == ','; }), name.end());
+		const string argString = attribute.substr(open + 1, close - open - 1);
+		pos = close + 1;
+
+		vector<float> args;
+		SvgScanner scan(argString);
+		float v;
+		while (scan.number(v)) {
+			args.push_back(v);
+		}
+
+		SvgTransform t = identity();
+		const int n = args.size();
+		if (name == "matrix" && n == 6) {
+			t = { args[0], args[1], args[2], args[3], args[4], args[5] };
+		} else if (name == "translate" && (n == 1 || n == 2)) {
+			t.e = args[0];
+			t.f = n == 2 ? args[1] : 0;
+		} else if (name == "scale" && (n == 1 || n == 2)) {
+			t.a = args[0];
+			t.d = n == 2 ? args[1] : args[0];
+		} else if (name == "rotate" && (n == 1 || n == 3)) {
+			const float rad = ofDegToRad(args[0]);
+			const SvgTransform r = { cosf(rad), sinf(rad), -sinf(rad), cosf(rad), 0, 0 };
+			if (n == 3) {
+				const SvgTransform to = { 1, 0, 0, 1, args[1], args[2] };
+				const SvgTransform from = { 1, 0, 0, 1, -args[1], -args[2] };
+				t = to * r * from;
+			} else {
+				t = r;
+			}
+		} else if (name == "skewX" && n == 1) {
+			t.c = tanf(ofDegToRad(args[0]));
+		} else if (name == "skewY" && n == 1) {
+			t.b = tanf(ofDegToRad(args[0]));
+		} else {
+			cout << "Skipping SVG transform " << name << "(" << argString << ")" << endl;
+			continue;
+		}
+		result = result * t;
+	}
+	return result;
+}
+
+static void addCurve(vector<SvgCurve> &curves, const SvgTransform &t, const ofVec2f &p0, const ofVec2f &p1, const ofVec2f &p2, const ofVec2f &p3, bool straight) {
+	curves.push_back({ t.apply(p0), t.apply(p1), t.apply(p2), t.apply(p3), straight });
+}
+
+static void addLine(vector<SvgCurve> &curves, const SvgTransform &t, const ofVec2f &from, const ofVec2f &to) {
+	addCurve(curves, t, from, from, to, to, true);
+}
+
+// Endpoint to center parameterization from the SVG spec (F.6.5), then one
+// cubic per quarter turn at most
+static void addArc(vector<SvgCurve> &curves, const SvgTransform &t, const ofVec2f &from, float rx, float ry, float rotation, bool largeArc, bool sweep, const ofVec2f &to) {
+	if (from == to) return;
+
+	double rX = fabs(rx), rY = fabs(ry);
+	if (rX == 0 || rY == 0) {
+		addLine(curves, t, from, to);
+		return;
+	}
+
+	const double phi = ofDegToRad(rotation);
+	const double cosPhi = cos(phi), sinPhi = sin(phi);
+	const double hx = (from.x - to.x) / 2.0, hy = (from.y - to.y) / 2.0;
+	const double x1 = cosPhi * hx + sinPhi * hy;
+	const double y1 = -sinPhi * hx + cosPhi * hy;
+
+	// Radii too small to reach are scaled up until they just do
+	const double lambda = (x1 * x1) / (rX * rX) + (y1 * y1) / (rY * rY);
+	if (lambda > 1) {
+		rX *= sqrt(lambda);
+		rY *= sqrt(lambda);
+	}
+
+	const double num = rX * rX * rY * rY - rX * rX * y1 * y1 - rY * rY * x1 * x1;
+	const double den = rX * rX * y1 * y1 + rY * rY * x1 * x1;
+	const double coef = (largeArc == sweep ? -1 : 1) * sqrt(max(0.0, num / den));
+	const double cx1 = coef * rX * y1 / rY;
+	const double cy1 = -coef * rY * x1 / rX;
+	const double cx = cosPhi * cx1 - sinPhi * cy1 + (from.x + to.x) / 2.0;
+	const double cy = sinPhi * cx1 + cosPhi * cy1 + (from.y + to.y) / 2.0;
+
+	const double theta = atan2((y1 - cy1) / rY, (x1 - cx1) / rX);
+	double delta = atan2((-y1 - cy1) / rY, (-x1 - cx1) / rX) - theta;
+	if (sweep && delta < 0) {
+		delta += TWO_PI;
+	} else if (!sweep && delta > 0) {
+		delta -= TWO_PI;
+	}
+
+	auto onEllipse = [&](double ux, double uy) {
+		return ofVec2f(cx + cosPhi * rX * ux - sinPhi * rY * uy, cy + sinPhi * rX * ux + cosPhi * rY * uy);
+	};
+
+	const int pieces = max(1, (int)ceil(fabs(delta) / HALF_PI - 1e-6));
+	const double step = delta / pieces;
+	const double k = 4.0 / 3.0 * tan(step / 4);
+
+	ofVec2f start = from;
+	for (int i = 0; i < pieces; ++i) {
+		const double t0 = theta + step * i, t1 = t0 + step;
+		const ofVec2f c1 = onEllipse(cos(t0) - k * sin(t0), sin(t0) + k * cos(t0));
+		const ofVec2f c2 = onEllipse(cos(t1) + k * sin(t1), sin(t1) - k * cos(t1));
+		const ofVec2f end = i == pieces - 1 ? to : onEllipse(cos(t1), sin(t1));
+		addCurve(curves, t, start, c1, c2, end, false);
+		start = end;
+	}
+}
+
+bool SvgPath::parse(const string &d, const SvgTransform &t) {
+	SvgScanner scan(d);
+	ofVec2f current(0, 0), subpathStart(0, 0);
+	// Last control point, for S and T to reflect
+	ofVec2f lastControl(0, 0);
+	char command = 0, previous = 0;
+
+	while (!scan.done()) {
+		if (isalpha(d[scan.i])) {
+			command = d[scan.i++];
+		} else if (command == 0 || command == 'Z' || command == 'z') {
+			// Numbers with no command to repeat
+			return false;
+		}
+
+		const bool relative = islower(command);
+		const char type = toupper(command);
+		const ofVec2f base = relative ? current : ofVec2f(0, 0);
+
+		ofVec2f p, c1, c2;
+		float x, y, rx, ry, rotation;
+		bool largeArc, sweep;
+
+		switch (type) {
+			case 'M':
+				if (!scan.point(p)) return false;
+				current = subpathStart = base + p;
+				// Pairs after the first are lines
+				command = relative ? 'l' : 'L';
+				break;
+			case 'L':
+				if (!scan.point(p)) return false;
+				addLine(curves, t, current, base + p);
+				current = base + p;
+				break;
+			case 'H':
+				if (!scan.number(x)) return false;
+				p = ofVec2f(base.x + x, current.y);
+				addLine(curves, t, current, p);
+				current = p;
+				break;
+			case 'V':
+				if (!scan.number(y)) return false;
+				p = ofVec2f(current.x, base.y + y);
+				addLine(curves, t, current, p);
+				current = p;
+				break;
+			case 'C':
+				if (!scan.point(c1) || !scan.point(c2) || !scan.point(p)) return false;
+				addCurve(curves, t, current, base + c1, base + c2, base + p, false);
+				lastControl = base + c2;
+				current = base + p;
+				break;
+			case 'S':
+				if (!scan.point(c2) || !scan.point(p)) return false;
+				c1 = (previous == 'C' || previous == 'S') ? current * 2 - lastControl : current;
+				addCurve(curves, t, current, c1, base + c2, base + p, false);
+				lastControl = base + c2;
+				current = base + p;
+				break;
+			case 'Q':
+				if (!scan.point(c1) || !scan.point(p)) return false;
+				c1 += base;
+				p += base;
+				addCurve(curves, t, current, current + (c1 - current) * (2.0f / 3), p + (c1 - p) * (2.0f / 3), p, false);
+				lastControl = c1;
+				current = p;
+				break;
+			case 'T':
+				if (!scan.point(p)) return false;
+				c1 = (previous == 'Q' || previous == 'T') ? current * 2 - lastControl : current;
+				p += base;
+				addCurve(curves, t, current, current + (c1 - current) * (2.0f / 3), p + (c1 - p) * (2.0f / 3), p, false);
+				lastControl = c1;
+				current = p;
+				break;
+			case 'A':
+				if (!scan.number(rx) || !scan.number(ry) || !scan.number(rotation) ||
+					!scan.flag(largeArc) || !scan.flag(sweep) || !scan.point(p)) return false;
+				addArc(curves, t, current, rx, ry, rotation, largeArc, sweep, base + p);
+				current = base + p;
+				break;
+			case 'Z':
+				if (current != subpathStart) {
+					addLine(curves, t, current, subpathStart);
+				}
+				current = subpathStart;
+				break;
+			default:
+				cout << "Unknown SVG path command " << command << endl;
+				return false;
+		}
+		previous = type;
+	}
+	return true;
+}
+
+void SvgPath::extend(ofVec2f &minP, ofVec2f &maxP) const {
+	for (const SvgCurve &c : curves) {
+		for (const ofVec2f &p : { c.p0, c.p1, c.p2, c.p3 }) {
+			minP.x = min(minP.x, p.x);
+			minP.y = min(minP.y, p.y);
+			maxP.x = max(maxP.x, p.x);
+			maxP.y = max(maxP.y, p.y);
+		}
+	}
+}
+
+static float segmentDistance(const ofVec2f &p, const ofVec2f &a, const ofVec2f &b) {
+	const ofVec2f ab = b - a;
+	const float lenSq = ab.lengthSquared();
+	if (lenSq == 0) {
+		return p.distance(a);
+	}
+	const float t = ofClamp((p - a).dot(ab) / lenSq, 0, 1);
+	return p.distance(a + ab * t);
+}
+
+// de Casteljau split at t
+static void splitCurve(const SvgCurve &c, float t, SvgCurve &left, SvgCurve &right) {
+	const ofVec2f p01 = c.p0.getInterpolated(c.p1, t), p12 = c.p1.getInterpolated(c.p2, t), p23 = c.p2.getInterpolated(c.p3, t);
+	const ofVec2f p012 = p01.getInterpolated(p12, t), p123 = p12.getInterpolated(p23, t);
+	const ofVec2f mid = p012.getInterpolated(p123, t);
+	left = { c.p0, p01, p012, mid, false };
+	right = { mid, p123, p23, c.p3, false };
+}
+
+// Every point on the curve is a blend of its control points that gives
+// the middle two at most 3/4 of the weight, so it strays from the chord by
+// at most 3/4 of their distance from it. That distance shrinks with the
+// square of the number of pieces, which gives the split, plus a little
+// since the estimate runs low on strong bends.
+static void flattenCurve(const SvgCurve &c, float tolerance, int depth, vector<pair<ofVec2f, ofVec2f>> &lines) {
+	const float bend = 0.75f * max(segmentDistance(c.p1, c.p0, c.p3), segmentDistance(c.p2, c.p0, c.p3));
+	if (depth >= kMaxFlattenDepth || bend <= tolerance) {
+		lines.push_back(make_pair(c.p0, c.p3));
+		return;
+	}
+
+	const int pieces = ofClamp(ceil(sqrt(bend / tolerance) * 1.1f), 2, kMaxFlattenPieces);
+	SvgCurve rest = c, piece;
+	for (int i = 0; i < pieces - 1; ++i) {
+		splitCurve(rest, 1.0f / (pieces - i), piece, rest);
+		flattenCurve(piece, tolerance, depth + 1, lines);
+	}
+	flattenCurve(rest, tolerance, depth + 1, lines);
+}
+
+void SvgPath::flatten(float tolerance, vector<pair<ofVec2f, ofVec2f>> &lines) const {
+	for (const SvgCurve &c : curves) {
+		if (c.straight) {
+			lines.push_back(make_pair(c.p0, c.p3));
+		} else {
+			flattenCurve(c, tolerance, 0, lines);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+//
+//  SvgPath.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef SvgPath_h
+#define SvgPath_h
+
+#include "ofMain.h"
+
+// Affine transform as in SVG's matrix(a b c d e f)
+typedef struct SvgTransform {
+	float a, b, c, d, e, f;
+
+	ofVec2f apply(const ofVec2f &p) const;
+
+	// This applied after other
+	SvgTransform operator*(const SvgTransform &other) const;
+
+	static SvgTransform identity();
+
+	// A transform attribute, e.g. "translate(10 20) rotate(45)". Unknown
+	// or malformed entries are skipped with a warning.
+	static SvgTransform parse(const string &attribute);
+} SvgTransform;
+
+// Cubic Bézier, lines have their control points on the ends
+typedef struct SvgCurve {
+	ofVec2f p0, p1, p2, p3;
+	bool straight;
+} SvgCurve;
+
+// The path data grammar: M L H V C S Q T A Z, absolute and relative.
+// Quadratics and arcs are kept as cubics, every point already transformed.
+class SvgPath {
+public:
+	// Parses d onto the end of curves. On a syntax error everything up to
+	// it is kept and false is returned, as SVG renderers do.
+	bool parse(const string &d, const SvgTransform &transform);
+
+	// Grows min and max over every end and control point
+	void extend(ofVec2f &min, ofVec2f &max) const;
+
+	// Lines that stay within tolerance of every curve, each curve split
+	// only as far as its own bend needs
+	void flatten(float tolerance, vector<pair<ofVec2f, ofVec2f>> &lines) const;
+
+	vector<SvgCurve> curves;
+};
+
+#endif /* SvgPath_h */
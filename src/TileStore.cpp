@@ -0,0 +1,550 @@
+//
+//  TileStore.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "TileStore.h"
+#include "Map.h"
+
+static const char kMagic[4] = { 'M', 'R', 'T', 'L' };
+static const uint8_t kVersion = 1;
+static const string kIndexName = "index.json";
+
+static const int kRecordBytes = 4 + 2 + 1 + 8 * 4;
+// Segments held in memory while writing before they go out to their tiles
+static const int kMaxPendingSegments = 100000;
+
+static void putRecord(const MapPath &mp, uint16_t type, char *out) {
+	const int32_t id = mp.id;
+	const uint8_t drawn = mp.drawn;
+	const float xy[8] = {
+		mp.segment.start.x, mp.segment.start.y, mp.segment.end.x, mp.segment.end.y,
+		mp.segment.prescaleStart.x, mp.segment.prescaleStart.y, mp.segment.prescaleEnd.x, mp.segment.prescaleEnd.y
+	};
+	memcpy(out, &id, 4);
+	memcpy(out + 4, &type, 2);
+	memcpy(out + 6, &drawn, 1);
+	memcpy(out + 7, xy, sizeof(xy));
+}
+
+static bool writeRecords(FILE *file, const vector<MapPath> &paths, const map<string, uint16_t> &typeIds) {
+	vector<char> bytes(paths.size() * kRecordBytes);
+	for (int i = 0; i < paths.size(); ++i) {
+		putRecord(paths[i], typeIds.at(paths[i].type), &bytes[i * kRecordBytes]);
+	}
+	return fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+static void countPath(map<string, TileCounts> &counts, const MapPath &mp, int sign) {
+	TileCounts &c = counts[mp.type];
+	const float length = mp.segment.start.distance(mp.segment.end);
+	c.total += sign;
+	c.drawn += mp.drawn ? sign : 0;
+	c.lengthM += length * sign;
+	c.drawnM += mp.drawn ? length * sign : 0;
+}
+
+static void addCounts(map<string, TileCounts> &to, const map<string, TileCounts> &from, int sign) {
+	for (auto &p : from) {
+		TileCounts &c = to[p.first];
+		c.total += p.second.total * sign;
+		c.drawn += p.second.drawn * sign;
+		c.lengthM += p.second.lengthM * sign;
+		c.drawnM += p.second.drawnM * sign;
+	}
+}
+
+TileStore::TileStore() :
+	tileSizeM(1),
+	cols(0), rows(0),
+	overhangM(0),
+	pendingCount(0),
+	busyTile(-1),
+	stopping(false)
+{}
+
+TileStore::~TileStore() {
+	if (writer.joinable()) {
+		{
+			lock_guard<mutex> l(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+	}
+}
+
+bool TileStore::exists(const string &dir) {
+	return ofFile::doesFileExist(ofFilePath::join(dir, kIndexName), false);
+}
+
+bool TileStore::create(const string &d, const ofRectangle &bounds, float tileSize, const vector<string> &types) {
+	if (!ofDirectory::doesDirectoryExist(d, false) && !ofDirectory::createDirectory(d, false, true)) {
+		cout << "Couldn't create tile directory " << d << endl;
+		return false;
+	}
+
+	dir = d;
+	origin = bounds.getTopLeft();
+	tileSizeM = tileSize;
+	// One extra row and column so the far edges are inside
+	cols = floor(bounds.getWidth() / tileSizeM) + 1;
+	rows = floor(bounds.getHeight() / tileSizeM) + 1;
+	overhangM = 0;
+	counts.assign(cols * rows, map<string, TileCounts>());
+	totals.clear();
+
+	pathTypes.clear();
+	typeIds.clear();
+	for (const string &type : types) {
+		typeIds[type] = pathTypes.size();
+		pathTypes.push_back(type);
+	}
+
+	pending.clear();
+	started.clear();
+	pendingCount = 0;
+	return true;
+}
+
+void TileStore::add(const MapPath &mp) {
+	if (typeIds.find(mp.type) == typeIds.end()) {
+		typeIds[mp.type] = pathTypes.size();
+		pathTypes.push_back(mp.type);
+	}
+
+	const int tile = tileOf(mp);
+	pending[tile].push_back(mp);
+	countPath(counts[tile], mp, 1);
+	countPath(totals, mp, 1);
+	overhangM = max(overhangM, mp.segment.start.distance(mp.segment.end) / 2);
+
+	if (++pendingCount >= kMaxPendingSegments) {
+		appendPending();
+	}
+}
+
+bool TileStore::appendPending() {
+	bool ok = true;
+	for (auto &p : pending) {
+		const bool first = started.insert(p.first).second;
+		FILE *file = fopen(tilePath(p.first).c_str(), first ? "wb" : "ab");
+		if (!file) {
+			cout << "Couldn't write tile " << tilePath(p.first) << endl;
+			ok = false;
+			continue;
+		}
+
+		if (first) {
+			fwrite(kMagic, 1, sizeof(kMagic), file);
+			fwrite(&kVersion, 1, 1, file);
+		}
+		ok = writeRecords(file, p.second, typeIds) && ok;
+		fclose(file);
+	}
+	pending.clear();
+	pendingCount = 0;
+	return ok;
+}
+
+static bool writeIndex(const string &dir, const string &json) {
+	const string path = ofFilePath::join(dir, kIndexName), tmpPath = path + ".tmp";
+	ofstream out(tmpPath.c_str());
+	out << json;
+	out.close();
+	if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		cout << "Couldn't write tile index in " << dir << endl;
+		return false;
+	}
+	return true;
+}
+
+bool TileStore::finish() {
+	const bool ok = appendPending() && writeIndex(dir, indexJson());
+	started.clear();
+
+	int segments = 0;
+	for (auto &p : totals) {
+		segments += p.second.total;
+	}
+	cout << "Wrote " << segments << " segments to " << cols << "x" << rows << " tiles in " << dir << endl;
+	return ok;
+}
+
+void TileStore::saveIndex() {
+	const string json = indexJson();
+	{
+		lock_guard<mutex> l(lock);
+		index = json;
+	}
+	queue(-1, TileEdit());
+}
+
+string TileStore::indexJson() const {
+	ofxJSONElement json;
+	json["version"] = kVersion;
+	json["origin"][0] = origin.x;
+	json["origin"][1] = origin.y;
+	json["tile_size"] = tileSizeM;
+	json["cols"] = cols;
+	json["rows"] = rows;
+	json["overhang"] = overhangM;
+	for (int i = 0; i < pathTypes.size(); ++i) {
+		json["types"][i] = pathTypes[i];
+	}
+
+	json["tiles"] = Json::Value(Json::arrayValue);
+	for (int tile = 0; tile < counts.size(); ++tile) {
+		if (counts[tile].empty()) continue;
+
+		Json::Value entry;
+		entry["tile"] = tile;
+		for (auto &p : counts[tile]) {
+			entry["counts"][p.first][0] = p.second.total;
+			entry["counts"][p.first][1] = p.second.drawn;
+			entry["counts"][p.first][2] = p.second.lengthM;
+			entry["counts"][p.first][3] = p.second.drawnM;
+		}
+		json["tiles"].append(entry);
+	}
+	return json.getRawString(false);
+}
+
+bool TileStore::open(const string &d) {
+	ofxJSONElement index;
+	if (!index.open(ofFilePath::join(d, kIndexName)) || index["version"].asInt() != kVersion) {
+		cout << "No tile index in " << d << endl;
+		return false;
+	}
+
+	dir = d;
+	origin = ofVec2f(index["origin"][0].asFloat(), index["origin"][1].asFloat());
+	tileSizeM = index["tile_size"].asFloat();
+	cols = index["cols"].asInt();
+	rows = index["rows"].asInt();
+	overhangM = index["overhang"].asFloat();
+	if (tileSizeM <= 0 || cols <= 0 || rows <= 0) {
+		cout << "Bad tile grid in " << d << endl;
+		return false;
+	}
+
+	pathTypes.clear();
+	typeIds.clear();
+	for (int i = 0; i < index["types"].size(); ++i) {
+		typeIds[index["types"][i].asString()] = pathTypes.size();
+		pathTypes.push_back(index["types"][i].asString());
+	}
+
+	counts.assign(cols * rows, map<string, TileCounts>());
+	totals.clear();
+	const Json::Value &tiles = index["tiles"];
+	vector<MapPath> paths;
+	for (int i = 0; i < tiles.size(); ++i) {
+		const int tile = tiles[i]["tile"].asInt();
+		if (tile < 0 || tile >= counts.size()) continue;
+
+		const Json::Value &c = tiles[i]["counts"];
+		bool lengths = true;
+		for (const string &type : c.getMemberNames()) {
+			const TileCounts tc = { c[type][0].asInt(), c[type][1].asInt(), c[type][2].asFloat(), c[type][3].asFloat() };
+			counts[tile][type] = tc;
+			lengths = lengths && c[type].size() >= 4;
+		}
+
+		// Stores written before lengths were kept are measured once
+		paths.clear();
+		if (!lengths && readFile(tile, pathTypes, paths)) {
+			counts[tile].clear();
+			for (auto &mp : paths) {
+				countPath(counts[tile], mp, 1);
+			}
+		}
+		addCounts(totals, counts[tile], 1);
+	}
+	return true;
+}
+
+int TileStore::tileOf(const MapPath &mp) const {
+	const ofVec2f mid = (mp.segment.start + mp.segment.end) / 2;
+	const int col = ofClamp(floor((mid.x - origin.x) / tileSizeM), 0, cols - 1);
+	const int row = ofClamp(floor((mid.y - origin.y) / tileSizeM), 0, rows - 1);
+	return row * cols + col;
+}
+
+int TileStore::tileAt(const ofVec2f &p) const {
+	const int col = floor((p.x - origin.x) / tileSizeM);
+	const int row = floor((p.y - origin.y) / tileSizeM);
+	if (col < 0 || col >= cols || row < 0 || row >= rows) {
+		return -1;
+	}
+	return row * cols + col;
+}
+
+ofRectangle TileStore::tileBounds(int tile) const {
+	return ofRectangle(origin.x + (tile % cols) * tileSizeM, origin.y + (tile / cols) * tileSizeM, tileSizeM, tileSizeM);
+}
+
+void TileStore::tilesNear(const ofVec2f &p, float marginM, set<int> &tiles) const {
+	const int minCol = max(0, (int)floor((p.x - marginM - origin.x) / tileSizeM));
+	const int maxCol = min(cols - 1, (int)floor((p.x + marginM - origin.x) / tileSizeM));
+	const int minRow = max(0, (int)floor((p.y - marginM - origin.y) / tileSizeM));
+	const int maxRow = min(rows - 1, (int)floor((p.y + marginM - origin.y) / tileSizeM));
+
+	for (int row = minRow; row <= maxRow; ++row) {
+		for (int col = minCol; col <= maxCol; ++col) {
+			tiles.insert(row * cols + col);
+		}
+	}
+}
+
+string TileStore::tilePath(int tile) const {
+	return ofFilePath::join(dir, "tile-" + ofToString(tile % cols) + "-" + ofToString(tile / cols) + ".bin");
+}
+
+bool TileStore::readTile(int tile, vector<MapPath> &paths) {
+	if (counts[tile].empty()) {
+		return true;
+	}
+
+	TileEdit edit;
+	const bool edited = takeEdit(tile, edit);
+	if (!readFile(tile, pathTypes, paths)) {
+		return false;
+	}
+	if (edited && applyEdit(edit, paths) > 0) {
+		map<string, TileCounts> c;
+		for (auto &mp : paths) {
+			countPath(c, mp, 1);
+		}
+		setCounts(tile, c);
+		stale.insert(tile);
+	}
+	return true;
+}
+
+bool TileStore::readFile(int tile, const vector<string> &types, vector<MapPath> &paths) const {
+	FILE *file = fopen(tilePath(tile).c_str(), "rb");
+	if (!file) {
+		cout << "Couldn't read tile " << tilePath(tile) << endl;
+		return false;
+	}
+
+	char magic[4];
+	uint8_t version = 0;
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, kMagic, sizeof(magic)) != 0
+		|| fread(&version, 1, 1, file) != 1 || version != kVersion) {
+		cout << "Not a tile: " << tilePath(tile) << endl;
+		fclose(file);
+		return false;
+	}
+
+	vector<char> bytes;
+	char chunk[64 * kRecordBytes];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		bytes.insert(bytes.end(), chunk, chunk + n);
+	}
+	fclose(file);
+
+	for (size_t i = 0; i + kRecordBytes <= bytes.size(); i += kRecordBytes) {
+		int32_t id;
+		uint16_t type;
+		uint8_t drawn;
+		float xy[8];
+		memcpy(&id, &bytes[i], 4);
+		memcpy(&type, &bytes[i + 4], 2);
+		memcpy(&drawn, &bytes[i + 6], 1);
+		memcpy(xy, &bytes[i + 7], sizeof(xy));
+		if (type >= types.size()) continue;
+
+		MapPath mp = { id, false, drawn != 0, types[type] };
+		mp.segment.start = ofVec2f(xy[0], xy[1]);
+		mp.segment.end = ofVec2f(xy[2], xy[3]);
+		mp.segment.prescaleStart = ofVec2f(xy[4], xy[5]);
+		mp.segment.prescaleEnd = ofVec2f(xy[6], xy[7]);
+		paths.push_back(mp);
+	}
+	return true;
+}
+
+bool TileStore::writeTile(int tile, const vector<MapPath> &paths) {
+	// What's in memory already has whatever was queued
+	TileEdit edit;
+	takeEdit(tile, edit);
+	stale.erase(tile);
+
+	map<string, TileCounts> c;
+	{
+		lock_guard<mutex> l(lock);
+		for (auto w = written.begin(); w != written.end(); ) {
+			w = w->first == tile ? written.erase(w) : w + 1;
+		}
+		for (const MapPath &mp : paths) {
+			if (typeIds.find(mp.type) == typeIds.end()) {
+				typeIds[mp.type] = pathTypes.size();
+				pathTypes.push_back(mp.type);
+			}
+			countPath(c, mp, 1);
+		}
+	}
+	setCounts(tile, c);
+	return writeFile(tile, typeIds, paths);
+}
+
+// Written aside and moved over so a crash leaves the old tile
+bool TileStore::writeFile(int tile, const map<string, uint16_t> &ids, const vector<MapPath> &paths) const {
+	const string path = tilePath(tile), tmpPath = path + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		cout << "Couldn't write tile " << path << endl;
+		return false;
+	}
+	fwrite(kMagic, 1, sizeof(kMagic), file);
+	fwrite(&kVersion, 1, 1, file);
+	const bool ok = writeRecords(file, paths, ids);
+	fclose(file);
+
+	return ok && rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+void TileStore::setCounts(int tile, const map<string, TileCounts> &c) {
+	addCounts(totals, counts[tile], -1);
+	counts[tile] = c;
+	addCounts(totals, counts[tile], 1);
+}
+
+void TileStore::queueUndraw(int tile) {
+	map<string, TileCounts> c = counts[tile];
+	for (auto &p : c) {
+		p.second.drawn = 0;
+		p.second.drawnM = 0;
+	}
+	setCounts(tile, c);
+
+	TileEdit edit;
+	edit.undraw = true;
+	queue(tile, edit);
+}
+
+void TileStore::queueDrawn(int tile, const shared_ptr<const set<int>> &ids) {
+	TileEdit edit;
+	edit.undraw = false;
+	edit.drawn.push_back(ids);
+	queue(tile, edit);
+}
+
+// A tile of -1 only wakes the thread for the index
+void TileStore::queue(int tile, const TileEdit &edit) {
+	{
+		lock_guard<mutex> l(lock);
+		if (tile >= 0) {
+			// Counts of drawn flags written before the undraw no longer hold
+			for (auto w = written.begin(); edit.undraw && w != written.end(); ) {
+				w = w->first == tile ? written.erase(w) : w + 1;
+			}
+			auto e = edits.find(tile);
+			if (e == edits.end() || edit.undraw) {
+				edits[tile] = edit;
+			} else {
+				e->second.drawn.insert(e->second.drawn.end(), edit.drawn.begin(), edit.drawn.end());
+			}
+		}
+	}
+	if (!writer.joinable()) {
+		writer = thread(&TileStore::writeLoop, this);
+	}
+	wake.notify_one();
+}
+
+int TileStore::applyEdit(const TileEdit &edit, vector<MapPath> &paths) {
+	int changed = 0;
+	for (auto &mp : paths) {
+		bool drawn = mp.drawn && !edit.undraw;
+		for (auto &ids : edit.drawn) {
+			drawn = drawn || ids->count(mp.id) > 0;
+		}
+		changed += drawn != mp.drawn;
+		mp.drawn = drawn;
+	}
+	return changed;
+}
+
+bool TileStore::takeEdit(int tile, TileEdit &edit) {
+	unique_lock<mutex> l(lock);
+	idle.wait(l, [&]() { return busyTile != tile; });
+	auto e = edits.find(tile);
+	if (e == edits.end()) {
+		return false;
+	}
+	edit = e->second;
+	edits.erase(e);
+	return true;
+}
+
+int TileStore::collectWritten() {
+	vector<pair<int, map<string, TileCounts>>> done;
+	{
+		lock_guard<mutex> l(lock);
+		done.swap(written);
+	}
+	for (auto &d : done) {
+		setCounts(d.first, d.second);
+	}
+	return done.size();
+}
+
+void TileStore::waitWritten() {
+	unique_lock<mutex> l(lock);
+	idle.wait(l, [this]() { return edits.empty() && index.empty() && busyTile < 0; });
+}
+
+void TileStore::writeLoop() {
+	unique_lock<mutex> l(lock);
+	while (true) {
+		wake.wait(l, [this]() { return stopping || !edits.empty() || !index.empty(); });
+		if (edits.empty() && index.empty()) {
+			break;
+		}
+
+		if (!edits.empty()) {
+			const int tile = edits.begin()->first;
+			const TileEdit edit = edits.begin()->second;
+			edits.erase(edits.begin());
+			const vector<string> types = pathTypes;
+			const map<string, uint16_t> ids = typeIds;
+			busyTile = tile;
+			l.unlock();
+
+			vector<MapPath> paths;
+			map<string, TileCounts> c;
+			bool ok = readFile(tile, types, paths) && applyEdit(edit, paths) > 0;
+			if (ok) {
+				for (auto &mp : paths) {
+					countPath(c, mp, 1);
+				}
+				ok = writeFile(tile, ids, paths);
+			}
+
+			l.lock();
+			busyTile = -1;
+			if (ok) {
+				written.push_back(make_pair(tile, c));
+			}
+		} else {
+			const string json = index;
+			l.unlock();
+
+			writeIndex(dir, json);
+
+			l.lock();
+			// Unless a newer one came in meanwhile
+			if (index == json) {
+				index.clear();
+			}
+		}
+		idle.notify_all();
+	}
+}
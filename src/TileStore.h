@@ -0,0 +1,129 @@
+//
+//  TileStore.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef TileStore_h
+#define TileStore_h
+
+#include "ofMain.h"
+#include "ofxJSON.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct MapPath;
+
+typedef struct TileCounts {
+	int total, drawn;
+	// Pen-down length of all the segments and of the drawn ones
+	float lengthM, drawnM;
+} TileCounts;
+
+// A map split into square tiles on disk, each segment in the tile holding
+// its midpoint, so only the part the robots are working on needs loading.
+//   index.json: grid, path types, longest segment and counts and lengths
+//     per tile
+//   tile-<col>-<row>.bin: "MRTL" uint8 version, then per segment
+//     int32 id, uint16 type, uint8 drawn, float start, end, prescale
+//     start and prescale end as x y pairs
+// Drawn flags of tiles that aren't loaded, and the index, are written on a
+// tile I/O thread.
+class TileStore {
+public:
+	TileStore();
+	// Waits for the tile I/O thread to finish writing
+	~TileStore();
+
+	static bool exists(const string &dir);
+
+	// Writing a new store. Segments can come in any order, they're kept in
+	// memory per tile and appended to the tile files as they pile up.
+	bool create(const string &dir, const ofRectangle &bounds, float tileSizeM, const vector<string> &pathTypes);
+	void add(const MapPath &path);
+	bool finish();
+
+	bool open(const string &dir);
+
+	// The tile a segment goes in, the nearest one if it's off the grid
+	int tileOf(const MapPath &path) const;
+	// -1 outside the grid
+	int tileAt(const ofVec2f &p) const;
+	ofRectangle tileBounds(int tile) const;
+	// Tiles overlapping the square reaching marginM around p
+	void tilesNear(const ofVec2f &p, float marginM, set<int> &tiles) const;
+
+	// With any drawn flags still waiting to be written
+	bool readTile(int tile, vector<MapPath> &paths);
+	// Replaces the tile's file and counts, saveIndex makes the counts stick
+	bool writeTile(int tile, const vector<MapPath> &paths);
+	// The index as it is now, written from the tile I/O thread
+	void saveIndex();
+
+	// Marks every segment of a tile undrawn, counted straight away
+	void queueUndraw(int tile);
+	// Marks the segments of a tile with these ids drawn, counted once
+	// collectWritten has them
+	void queueDrawn(int tile, const shared_ptr<const set<int>> &ids);
+	// Takes in the counts of the tiles written since, returns how many
+	int collectWritten();
+	// Until everything queued is written
+	void waitWritten();
+
+	string dir;
+	ofVec2f origin;
+	float tileSizeM;
+	int cols, rows;
+	vector<string> pathTypes;
+	// Half the longest segment, as far as any reaches out of its tile
+	float overhangM;
+
+	// Per tile, by type, as last written
+	vector<map<string, TileCounts>> counts;
+	// The same summed over every tile
+	map<string, TileCounts> totals;
+	// Loaded before queued drawn flags were written, so their files are
+	// behind
+	set<int> stale;
+
+private:
+	typedef struct TileEdit {
+		bool undraw;
+		vector<shared_ptr<const set<int>>> drawn;
+	} TileEdit;
+
+	string tilePath(int tile) const;
+	bool appendPending();
+	string indexJson() const;
+	void setCounts(int tile, const map<string, TileCounts> &c);
+	bool readFile(int tile, const vector<string> &types, vector<MapPath> &paths) const;
+	bool writeFile(int tile, const map<string, uint16_t> &ids, const vector<MapPath> &paths) const;
+	// Takes the edit queued for a tile once the I/O thread is done with it
+	bool takeEdit(int tile, TileEdit &edit);
+	// Returns how many drawn flags changed
+	static int applyEdit(const TileEdit &edit, vector<MapPath> &paths);
+	void queue(int tile, const TileEdit &edit);
+	void writeLoop();
+
+	map<int, vector<MapPath>> pending;
+	map<string, uint16_t> typeIds;
+	set<int> started;
+	int pendingCount;
+
+	thread writer;
+	mutex lock;
+	condition_variable wake, idle;
+	map<int, TileEdit> edits;
+	string index;
+	// Being written, -1 for none
+	int busyTile;
+	vector<pair<int, map<string, TileCounts>>> written;
+	bool stopping;
+};
+
+#endif /* TileStore_h */
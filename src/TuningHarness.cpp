@@ -0,0 +1,283 @@
+//
+//  TuningHarness.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "TuningHarness.h"
+#include "ofxJSON.h"
+
+#include <random>
+
+static const int kParamCount = 9;
+
+static float *paramAt(TuningParams &p, int i) {
+	float *fields[kParamCount] = { &p.kp, &p.ki, &p.kd, &p.maxI, &p.minSpeed, &p.maxSpeed, &p.speedRamp, &p.maxAccel, &p.maxJerk };
+	return fields[i];
+}
+
+static const char *kParamNames[kParamCount] = { "kp", "ki", "kd", "maxI", "minSpeed", "maxSpeed", "speedRamp", "maxAccel", "maxJerk" };
+
+// Robot commands carry a world angle in robot degrees, see ofRadToRobotDeg.
+static ofVec2f commandVelocity(const char *cmd, float speedUnitsPerMps) {
+	int angle = 0, magnitude = 0, measured = 0;
+	if (sscanf(cmd, "MRDRW%d%d%d", &angle, &magnitude, &measured) != 3 &&
+		sscanf(cmd, "MRMOV%d%d%d", &angle, &magnitude, &measured) != 3) {
+		return ofVec2f(0, 0);
+	}
+
+	const float rad = ofDegToRad(90 - angle);
+	return ofVec2f(cos(rad), sin(rad)) * (magnitude / speedUnitsPerMps);
+}
+
+TuningHarness::TuningHarness() :
+	randomSamples(256),
+	refineRounds(6),
+	refineSamples(64),
+	numThreads(max(1u, thread::hardware_concurrency())),
+	crossTrackRmsWeight(2000),
+	crossTrackMaxWeight(500),
+	overshootWeight(1000),
+	timeWeight(1),
+	incompletePenalty(20),
+	tickSec(1.0 / 60.0),
+	segmentTimeoutSec(10),
+	velocityLagSec(0.1),
+	deadbandSpeed(0.02),
+	driftMps(0.01),
+	cameraNoiseM(0.001)
+{
+	minParams = { 0, 0, 0, 0, 50, 200, 0.02, 0.1, 0 };
+	maxParams = { 30000, 5000, 50, 20000, 300, 1024, 0.5, 2, 20 };
+
+	// Short strokes dominate real maps, add a few long ones in every direction.
+	const float lengths[] = { 0.02, 0.05, 0.1, 0.2, 0.4 };
+	for (int i = 0; i < 5; ++i) {
+		for (int a = 0; a < 4; ++a) {
+			const float angle = (a * 90 + i * 37) * DEG_TO_RAD;
+			TuningSegment s;
+			s.start = ofVec2f(-0.1, -0.1);
+			s.end = s.start + ofVec2f(cos(angle), sin(angle)) * lengths[i];
+			segments.push_back(s);
+		}
+	}
+}
+
+TuningParams TuningHarness::paramsFromRobot(const Robot &r) {
+	TuningParams p = { r.targetLineKp, r.targetLineKi, r.targetLineKd, r.targetLineMaxI,
+		r.minSpeed, r.maxSpeed, r.speedRamp, r.maxAccel, r.maxJerk };
+	return p;
+}
+
+void TuningHarness::applyParams(Robot &r, const TuningParams &p) {
+	r.updatePID(p.kp, p.ki, p.kd, p.maxI);
+	r.minSpeed = p.minSpeed;
+	r.maxSpeed = p.maxSpeed;
+	r.speedRamp = p.speedRamp;
+	r.maxAccel = p.maxAccel;
+	r.maxJerk = p.maxJerk;
+}
+
+TuningScore TuningHarness::evaluate(const TuningParams &params) const {
+	TuningScore score = { 0, 0, 0, 0, 0, 0 };
+
+	SimClock clock;
+	Robot r(0, -1, "tuning", &clock);
+	r.logging = false;
+	applyParams(r, params);
+
+	double sqErrorSum = 0;
+	int samples = 0;
+	float totalTime = 0;
+	char buf[128];
+
+	for (int i = 0; i < segments.size(); ++i) {
+		const TuningSegment &seg = segments[i];
+		const ofVec2f dir = (seg.end - seg.start).getNormalized();
+		const float length = seg.start.distance(seg.end);
+
+		// Same disturbances for every parameter set so scores are comparable.
+		mt19937 rng(i * 7919 + 1);
+		normal_distribution<float> noise(0, cameraNoiseM);
+		const ofVec2f drift = dir.getPerpendicular() * driftMps * (i % 2 ? 1.0f : -1.0f);
+
+		ofVec2f pos = seg.start, vel(0, 0), commanded(0, 0);
+		r.planePos = pos;
+		r.avgPlanePos = pos;
+		r.drawLine(seg.start, seg.end);
+
+		float t = 0;
+		int tick = 0;
+		bool done = false;
+		while (t < segmentTimeoutSec) {
+			r.planePos = pos + ofVec2f(noise(rng), noise(rng));
+			if (r.inPosition(r.planePos)) {
+				done = true;
+				break;
+			}
+
+			bool shouldSend = false;
+			r.moveRobot(buf, true, tickSec, shouldSend);
+			if (shouldSend && tick % 4 == 0) {
+				commanded = commandVelocity(buf, r.speedUnitsPerMps);
+				if (commanded.length() < deadbandSpeed) {
+					commanded.set(0, 0);
+				}
+			}
+
+			vel += (commanded - vel) * min(1.0f, tickSec / velocityLagSec);
+			pos += (vel + drift) * tickSec;
+			clock.advance(tickSec);
+			t += tickSec;
+			tick++;
+
+			const ofVec2f fromStart = pos - seg.start;
+			const float crossTrack = fabs(fromStart.dot(dir.getPerpendicular()));
+			sqErrorSum += crossTrack * crossTrack;
+			samples++;
+			score.crossTrackMax = max(score.crossTrackMax, crossTrack);
+			score.overshoot = max(score.overshoot, fromStart.dot(dir) - length);
+		}
+
+		totalTime += t;
+		if (done) {
+			score.segmentsCompleted++;
+		}
+	}
+
+	score.crossTrackRms = samples > 0 ? sqrt(sqErrorSum / samples) : 0;
+	score.secPerSegment = totalTime / segments.size();
+	score.cost = crossTrackRmsWeight * score.crossTrackRms
+		+ crossTrackMaxWeight * score.crossTrackMax
+		+ overshootWeight * score.overshoot
+		+ timeWeight * score.secPerSegment
+		+ incompletePenalty * (segments.size() - score.segmentsCompleted);
+	return score;
+}
+
+TuningParams TuningHarness::sample(const TuningParams &center, float radius, unsigned int seed) const {
+	mt19937 rng(seed);
+	uniform_real_distribution<float> unit(-1, 1);
+
+	TuningParams p = center;
+	TuningParams lo = minParams, hi = maxParams;
+	for (int i = 0; i < kParamCount; ++i) {
+		const float span = *paramAt(hi, i) - *paramAt(lo, i);
+		*paramAt(p, i) = ofClamp(*paramAt(p, i) + unit(rng) * radius * span, *paramAt(lo, i), *paramAt(hi, i));
+	}
+
+	// A cruise speed below the minimum makes no sense.
+	p.maxSpeed = max(p.maxSpeed, p.minSpeed);
+	return p;
+}
+
+vector<TuningScore> TuningHarness::evaluateAll(const vector<TuningParams> &candidates) const {
+	vector<TuningScore> scores(candidates.size());
+	atomic<int> next(0);
+
+	vector<thread> workers;
+	for (int t = 0; t < numThreads; ++t) {
+		workers.push_back(thread([&]() {
+			for (int i = next++; i < candidates.size(); i = next++) {
+				scores[i] = evaluate(candidates[i]);
+			}
+		}));
+	}
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	return scores;
+}
+
+TuningParams TuningHarness::tune(TuningScore &bestScore) {
+	// Start from the current defaults so we never report anything worse.
+	Robot defaults(0, -1, "defaults");
+	TuningParams best = paramsFromRobot(defaults);
+	bestScore = evaluate(best);
+
+	TuningParams mid = minParams;
+	for (int i = 0; i < kParamCount; ++i) {
+		*paramAt(mid, i) = (*paramAt(minParams, i) + *paramAt(maxParams, i)) * 0.5f;
+	}
+
+	unsigned int seed = 1;
+	float radius = 1.0;
+	for (int round = 0; round <= refineRounds; ++round) {
+		vector<TuningParams> candidates;
+		const int n = round == 0 ? randomSamples : refineSamples;
+		for (int i = 0; i < n; ++i) {
+			candidates.push_back(round == 0 ? sample(mid, radius, seed++) : sample(best, radius, seed++));
+		}
+
+		vector<TuningScore> scores = evaluateAll(candidates);
+		for (int i = 0; i < scores.size(); ++i) {
+			if (scores[i].cost < bestScore.cost) {
+				bestScore = scores[i];
+				best = candidates[i];
+			}
+		}
+
+		cout << "Tuning round " << round << ": best cost " << bestScore.cost
+			<< " (rms " << bestScore.crossTrackRms * 1000.0 << "mm, overshoot " << bestScore.overshoot * 1000.0
+			<< "mm, " << bestScore.secPerSegment << "s/segment)" << endl;
+
+		radius = round == 0 ? 0.25 : radius * 0.6;
+	}
+
+	return best;
+}
+
+bool TuningHarness::saveProfile(const string &path, const TuningParams &params, const TuningScore &score) {
+	ofxJSONElement json;
+	TuningParams p = params;
+	for (int i = 0; i < kParamCount; ++i) {
+		json[kParamNames[i]] = *paramAt(p, i);
+	}
+
+	json["score"]["cost"] = score.cost;
+	json["score"]["crossTrackRms"] = score.crossTrackRms;
+	json["score"]["crossTrackMax"] = score.crossTrackMax;
+	json["score"]["overshoot"] = score.overshoot;
+	json["score"]["secPerSegment"] = score.secPerSegment;
+	json["score"]["segmentsCompleted"] = score.segmentsCompleted;
+
+	return json.save(path, true);
+}
+
+bool TuningHarness::loadProfile(const string &path, TuningParams &params) {
+	ofxJSONElement json;
+	if (!json.open(path)) {
+		return false;
+	}
+
+	for (int i = 0; i < kParamCount; ++i) {
+		if (!json.isMember(kParamNames[i])) {
+			cout << "Tuning profile " << path << " is missing " << kParamNames[i] << endl;
+			return false;
+		}
+	}
+
+	for (int i = 0; i < kParamCount; ++i) {
+		*paramAt(params, i) = json[kParamNames[i]].asFloat();
+	}
+	return true;
+}
+
+int runTuning(const string &outputPath) {
+	TuningHarness harness;
+	cout << "Tuning on " << harness.numThreads << " threads over " << harness.segments.size() << " segments" << endl;
+
+	TuningScore score;
+	TuningParams best = harness.tune(score);
+
+	if (!TuningHarness::saveProfile(outputPath, best, score)) {
+		cout << "Couldn't write tuning profile to " << outputPath << endl;
+		return 1;
+	}
+
+	cout << "Wrote tuning profile to " << outputPath << endl;
+	return 0;
+}
@@ -0,0 +1,70 @@
+//
+//  TuningHarness.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef TuningHarness_h
+#define TuningHarness_h
+
+#include "ofMain.h"
+#include "Robot.h"
+
+// Everything the line follower exposes as a GUI slider.
+typedef struct TuningParams {
+	float kp, ki, kd, maxI;
+	float minSpeed, maxSpeed, speedRamp;
+	float maxAccel, maxJerk;
+} TuningParams;
+
+typedef struct TuningScore {
+	float crossTrackRms, crossTrackMax;
+	float overshoot;
+	float secPerSegment;
+	int segmentsCompleted;
+	float cost;
+} TuningScore;
+
+typedef struct TuningSegment {
+	ofVec2f start, end;
+} TuningSegment;
+
+class TuningHarness {
+public:
+	TuningHarness();
+
+	// Search the parameter ranges and return the lowest cost set found.
+	TuningParams tune(TuningScore &bestScore);
+
+	// Run one parameter set over every test segment against the simulated plant.
+	TuningScore evaluate(const TuningParams &params) const;
+
+	static TuningParams paramsFromRobot(const Robot &r);
+	static void applyParams(Robot &r, const TuningParams &params);
+	static bool saveProfile(const string &path, const TuningParams &params, const TuningScore &score);
+	static bool loadProfile(const string &path, TuningParams &params);
+
+	// Search space and budget
+	TuningParams minParams, maxParams;
+	int randomSamples, refineRounds, refineSamples;
+	int numThreads;
+
+	// Cost weights
+	float crossTrackRmsWeight, crossTrackMaxWeight, overshootWeight, timeWeight, incompletePenalty;
+
+	// Plant
+	float tickSec, segmentTimeoutSec;
+	float velocityLagSec, deadbandSpeed, driftMps, cameraNoiseM;
+
+	vector<TuningSegment> segments;
+
+private:
+	TuningParams sample(const TuningParams &center, float radius, unsigned int seed) const;
+	vector<TuningScore> evaluateAll(const vector<TuningParams> &candidates) const;
+};
+
+int runTuning(const string &outputPath);
+
+#endif /* TuningHarness_h */
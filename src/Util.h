@@ -19,19 +19,22 @@ const int RIGHT = 2;  // 0010
 const int BOTTOM = 4; // 0100
 const int TOP = 8;    // 1000
 
+// Points this far outside still count as inside
+const float kClipSlack = 0.001;
+
 static OutCode ComputeOutCode(const ofVec2f &pt, const ofRectangle &rect) {
 	OutCode code;
 
 	const ofVec2f tl = rect.getTopLeft(), br = rect.getBottomRight();
 	code = INSIDE;          // initialised as being inside of [[clip window]]
 
-	if (pt.x < tl.x - 0.001)           // to the left of clip window
+	if (pt.x < tl.x - kClipSlack)           // to the left of clip window
 		code |= LEFT;
-	else if (pt.x > br.x + 0.001)      // to the right of clip window
+	else if (pt.x > br.x + kClipSlack)      // to the right of clip window
 		code |= RIGHT;
-	if (pt.y < tl.y - 0.001)           // below the clip window
+	if (pt.y < tl.y - kClipSlack)           // below the clip window
 		code |= TOP;
-	else if (pt.y > br.y + 0.001)      // above the clip window
+	else if (pt.y > br.y + kClipSlack)      // above the clip window
 		code |= BOTTOM;
 
 	return code;
@@ -82,12 +85,10 @@ static bool CohenSutherlandLineClip(ofVec2f &pt1, ofVec2f &pt2, const ofRectangl
 				pt1.x = clip.x;
 				pt1.y = clip.y;
 				outcode0 = ComputeOutCode(pt1, rect);
-				cout << "pt1 is now" << pt1 << " - " << outcode0 << endl;
 			} else {
 				pt2.x = clip.x;
 				pt2.y = clip.y;
 				outcode1 = ComputeOutCode(pt2, rect);
-				cout << "pt2 is now" << pt2 << " - " << outcode1 << endl;
 			}
 		}
 	}
@@ -0,0 +1,83 @@
+//
+//  VelocityProfile.cpp
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#include "VelocityProfile.h"
+
+VelocityProfile::VelocityProfile() :
+	maxAccel(0.5),
+	maxJerk(5.0),
+	speed(0),
+	accel(0)
+{}
+
+void VelocityProfile::setLimits(float a, float j) {
+	maxAccel = a;
+	maxJerk = j;
+}
+
+void VelocityProfile::reset(float startSpeed) {
+	speed = startSpeed;
+	accel = 0;
+}
+
+float VelocityProfile::stoppingSpeed(float distance, float endSpeed, float a, float j) {
+	if (distance <= 0) {
+		return endSpeed;
+	}
+
+	if (j <= 0) {
+		// Constant deceleration: v^2 - e^2 = 2ad
+		return sqrt(endSpeed * endSpeed + 2.0f * a * distance);
+	}
+
+	// With the jerk ramps, braking from v to e takes
+	// d = (v^2 - e^2) / 2a + (v + e) * a / 2j, a quadratic in v
+	const float b = a * a / j;
+	const float c = b - 2.0f * endSpeed;
+	return max(endSpeed, (-b + sqrt(c * c + 8.0f * a * distance)) * 0.5f);
+}
+
+float VelocityProfile::update(float dt, float distanceToEnd, float cruiseSpeed, float endSpeed) {
+	if (maxAccel <= 0 || dt <= 0) {
+		return speed;
+	}
+
+	const float stopSpeed = stoppingSpeed(distanceToEnd, endSpeed, maxAccel, maxJerk);
+	const float targetSpeed = min(cruiseSpeed, stopSpeed);
+	const float dv = targetSpeed - speed;
+
+	if (maxJerk <= 0) {
+		accel = ofClamp(dv / dt, -maxAccel, maxAccel);
+	} else {
+		// Acceleration that lets us ramp it back to zero right as we reach
+		// the target speed, approached at no more than maxJerk.
+		float desiredAccel = min(maxAccel, sqrt(2.0f * maxJerk * fabs(dv)));
+		desiredAccel = min(desiredAccel, fabs(dv) / dt);
+		if (dv < 0) {
+			desiredAccel = -desiredAccel;
+		}
+
+		const float maxStep = maxJerk * dt;
+		accel += ofClamp(desiredAccel - accel, -maxStep, maxStep);
+	}
+
+	speed += accel * dt;
+
+	// Never outrun the braking curve, stopping accurately matters more
+	// than a smooth last few millimeters.
+	if (speed > stopSpeed) {
+		speed = stopSpeed;
+		accel = min(accel, 0.0f);
+	}
+	if (speed < endSpeed) {
+		speed = endSpeed;
+		accel = max(accel, 0.0f);
+	}
+
+	return speed;
+}
@@ -0,0 +1,34 @@
+//
+//  VelocityProfile.h
+//  maproom-robot
+//
+//  Created by maproom on 10/19/26.
+//
+//
+
+#ifndef VelocityProfile_h
+#define VelocityProfile_h
+
+#include "ofMain.h"
+
+// Online S-curve speed planner for a single segment. Speeds are in m/s,
+// acceleration in m/s^2 and jerk in m/s^3. A jerk limit <= 0 gives a
+// plain trapezoidal profile.
+class VelocityProfile {
+public:
+	VelocityProfile();
+
+	void setLimits(float maxAccel, float maxJerk);
+	void reset(float startSpeed);
+
+	// Advance by dt and return the speed to command with distanceToEnd left.
+	float update(float dt, float distanceToEnd, float cruiseSpeed, float endSpeed);
+
+	// Highest speed from which we can still slow to endSpeed within distance.
+	static float stoppingSpeed(float distance, float endSpeed, float maxAccel, float maxJerk);
+
+	float maxAccel, maxJerk;
+	float speed, accel;
+};
+
+#endif /* VelocityProfile_h */
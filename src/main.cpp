@@ -1,13 +1,35 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "TuningHarness.h"
+#include "Benchmark.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// Headless tools
+	if (argc > 1 && string(argv[1]) == "--tune") {
+		return runTuning(argc > 2 ? argv[2] : "tuning-profile.json");
+	} else if (argc > 1 && string(argv[1]) == "--bench-mpc") {
+		return runControllerBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+	} else if (argc > 1 && string(argv[1]) == "--bench-map") {
+		return runMapBenchmark(argc > 2 ? argv[2] : "bench-map.jsonl");
+	} else if (argc > 1 && string(argv[1]) == "--bench-job") {
+		return runJobBenchmark(argc > 2 ? argv[2] : "", argc > 3 ? atoi(argv[3]) : 2, argc > 4 ? atoi(argv[4]) : 8);
+	} else if (argc > 2 && string(argv[1]) == "--bench-replay") {
+		return runReplayBenchmark(argv[2]);
+	}
+
 	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
+	ofApp *app = new ofApp();
+	app->replayFast = false;
+	if (argc > 2 && string(argv[1]) == "--replay") {
+		app->replayPath = argv[2];
+		app->replayFast = argc > 3 && string(argv[3]) == "--fast";
+	}
+
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(app);
 
 }
@@ -1,11 +1,22 @@
 #include "ofApp.h"
+#include "TuningHarness.h"
+#include "Profiler.h"
+#include "Assignment.h"
+#include "LoadBalancer.h"
 
 static const string kDefaultMapPath = "test.svg";
 static const string kDownloadPath = "/Users/maproom/Downloads/";
+static const string kRecordingDir = "recordings";
+static const string kJournalDir = "journal";
+static const string kFleetPath = "fleet.json";
 
 static const string kRPiHost = "192.168.7.52";
 static const int kRPiPort = 5300;
 
+static const int kMetricsPort = 5102;
+static const float kMetricsIntervalSec = 1.0f;
+static const float kMetricsRateWindowSec = 60.0f;
+
 static const float kMapWidthM = 1.0f;
 static const float kMapHeightM = 1.0f;
 static const float kMapOffsetXM = -kMapWidthM / 2.0;
@@ -19,8 +30,50 @@ static const bool debugging = true;
 static const float kRobotSafetyDiameter = 0.18f;
 static const float kRobotOuterSafetyDiameter = 0.25f;
 
+// Collision prediction looks this far ahead, sized for the fastest robot
+static const float kCollisionHorizonSec = 1.5f;
+static const float kMaxRobotSpeedMps = 0.3f;
+// Robots held this long are deadlocked and back away from each other. If
+// they stay inside the inner safety zone that long, all retreat to corners.
+static const float kDeadlockSec = 8.0f;
+static const float kTooCloseHoldSec = 1.0f;
+// Released for less than this still counts towards the hold
+static const float kHoldReleaseSec = 1.0f;
+static const float kBackOffM = 0.15f;
+static const float kRetreatCooldownSec = 15.0f;
+// Retreat assignment minimises the longest trip rather than the total.
+// Min-total straight paths never cross, min-max ones may.
+static const bool kStagingMinimizeMax = false;
+
+// Segments are reserved for the time they'd take at this fraction of top
+// speed plus settling, so robots rarely run past their windows
+static const float kPlanningSpeedFactor = 0.5f;
+static const float kPlanningSettleSec = 1.0f;
+// A robot that hasn't found a free segment for this long stops waiting on
+// robots that are standing still, avoidance moves them out of the way
+static const float kReservationWaitSec = 5.0f;
+
+// How often an idle robot looks for work to take over
+static const float kBalanceIntervalSec = 1.0f;
+
 static const int kNumPathsToSave = 10000;
 
+// Maps with more segments than this are drawn from tiles on disk, only the
+// ones within the prefetch margin of a robot loaded
+static const int kTiledMapSegments = 50000;
+static const float kTileSizeM = 0.25f;
+static const float kTilePrefetchM = 0.2f;
+static const string kTileDir = "tiles";
+
+// Simulated seconds per wall second when SIMULATING
+static const float kSimulationSpeed = 1.0f;
+
+// Seconds between refreshes of the timings panel
+static const float kProfileGuiIntervalSec = 0.5f;
+
+// Wall time per update spent replaying a log with replayFast
+static const float kFastReplayBudgetSec = 1.0f / 60.0f;
+
 static char udpMessage[1024];
 static char buf[1024];
 
@@ -50,29 +103,58 @@ void ofApp::setup() {
 	cam.setTarget(ofVec3f(0.0));
 	cam.setNearClip(0.01);
 
-	Robot *r01 = new Robot(1, 23, "Delmar");
-	robotsById[r01->id] = r01;
-	robotsByMarker[r01->markerId] = r01;
-	r01->setCommunication("192.168.7.74", 5111);
-	r01->planePos = ofVec2f(-2);
+	headless = false;
+	clock = Clock::real();
+	simClock = NULL;
+	simulator = NULL;
+	replayer = NULL;
+	replayClock = NULL;
+	gui = NULL;
+	pathGui = NULL;
+	currentMap = NULL;
+
+	if (!replayPath.empty()) {
+		replayClock = new ReplayClock();
+		clock = replayClock;
+	}
+#if SIMULATING
+	if (!replayClock) {
+		simClock = new SimClock();
+		clock = simClock;
+	}
+#endif
 
-	Robot *r02 = new Robot(2, 26, "Camille");
-	robotsById[r02->id] = r02;
-	robotsByMarker[r02->markerId] = r02;
-	r02->setCommunication("192.168.7.73", 5111);
-	r02->planePos = ofVec2f(2);
+	collisions.configure(kRobotSafetyDiameter, kRobotOuterSafetyDiameter, kCollisionHorizonSec, kMaxRobotSpeedMps);
+	reservations.configure(kRobotOuterSafetyDiameter);
+	balanceLoad = true;
+	lastRetreatTime = -kRetreatCooldownSec;
 
 #if SIMULATING
-	r01->planePos = ofVec2f(-0.35);
-	r02->planePos = ofVec2f(0.35);
-	r01->upVec = ofVec2f(0.0, 1.0);
-	r02->upVec = ofVec2f(0.0, 1.0);
+	if (!replayClock) {
+		simulator = new Simulator(defaultSimConfig());
+	}
+#endif
+
+	journaling = false;
+#if JOURNAL_PROGRESS
+	journaling = !replayClock;
+#endif
+
+#if RECORD_INPUTS
+	if (!replayClock) {
+		ofDirectory::createDirectory(kRecordingDir, true, true);
+		recorder.open(ofToDataPath(kRecordingDir + "/inputs-" + ofGetTimestampString("%Y-%m-%d-%H-%M-%S") + ".mrin", true));
+	}
 #endif
 
-//	Robot *r03 = new Robot(3, 24, "Archie");
-//	robotsById[r03->id] = r03;
-//	robotsByMarker[r03->markerId] = r03;
-//	r03->setCommunication("192.168.7.71", 5111);
+	// A replay gets the robots the run had from its fleet command
+	if (!replayClock) {
+		robotSender.open();
+		loadFleet(kFleetPath);
+	}
+
+	// Slider starting values, the same for every robot
+	const Robot defaults(0, -1, "defaults", clock);
 
 	// set up GUI
     gui = new ofxDatGui( ofxDatGuiAnchor::TOP_RIGHT );
@@ -86,13 +168,13 @@ void ofApp::setup() {
 	stopButton = gui->addButton("Stop");
 
 	startButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
-		setState(MR_RUNNING);
+		runCommand("state " + ofToString(MR_RUNNING));
 	});
 	pauseButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
-		setState(MR_PAUSED);
+		runCommand("state " + ofToString(MR_PAUSED));
 	});
 	stopButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
-		setState(MR_STOPPED);
+		runCommand("state " + ofToString(MR_STOPPED));
 	});
 
 	gui->addBreak();
@@ -103,95 +185,103 @@ void ofApp::setup() {
 	rpiStateDropdown->select(0);
 	rpiStateDropdown->onDropdownEvent([this](ofxDatGuiDropdownEvent e) {
 		int index = e.target->getSelected()->getIndex();
-		ofxOscMessage m;
-		m.setAddress("/state");
-		m.addIntArg(index);
-		oscToRPi.sendMessage(m, false);
+		runCommand("rpi-state " + ofToString(index));
 	});
 
 	gui->addBreak();
     
-    for (map<int, Robot*>::iterator it = robotsById.begin(); it != robotsById.end(); ++it) {
-        int robotId = it->first;
-        Robot &r = *it->second;
-		RobotGui &rGui = robotGuis[robotId];
-
-		rGui.folder = gui->addFolder(ofToString(r.name.c_str()) + " (" + ofToString(r.id) + ")", ofColor::white);
-		rGui.folder->expand();
-
-        rGui.stateLabel = rGui.folder->addLabel(r.stateDescription());
-		rGui.posLabel = rGui.folder->addLabel(r.positionString());
-		rGui.lastMessageLabel = rGui.folder->addLabel("");
-        rGui.advanceButton = rGui.folder->addButton("Skip path");
-        rGui.advanceButton->onButtonEvent([&r](ofxDatGuiButtonEvent e) {
-            r.setState(R_DONE_DRAWING);
-        });
-
-		gui->addBreak();
-    }
+	for (auto &p : robotsById) {
+		addRobotGui(*p.second);
+	}
 
 	robotConstantsFolder = gui->addFolder("Robot Constants");
 	kpSlider = robotConstantsFolder->addSlider("kp", 0, 30000);
-	kpSlider->setValue(r01->targetLineKp);
+	kpSlider->setValue(defaults.targetLineKp);
 	kiSlider = robotConstantsFolder->addSlider("ki", 0, 5000);
-	kiSlider->setValue(r01->targetLineKi);
+	kiSlider->setValue(defaults.targetLineKi);
 	kdSlider = robotConstantsFolder->addSlider("kd", 0, 50);
-	kdSlider->setValue(r01->targetLineKd);
+	kdSlider->setValue(defaults.targetLineKd);
 	kMaxISlider = robotConstantsFolder->addSlider("kMaxI", 0, 20000);
-	kMaxISlider->setValue(r01->targetLineMaxI);
+	kMaxISlider->setValue(defaults.targetLineMaxI);
 	robotConstantsFolder->addBreak();
 	minSpeedSlider = robotConstantsFolder->addSlider("minSpeed", 0, 1024);
-	minSpeedSlider->setValue(r01->minSpeed);
+	minSpeedSlider->setValue(defaults.minSpeed);
 	minSpeedSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
-		for (auto &p : robotsById) {
-			Robot &r = *p.second;
-			r.minSpeed = e.value;
-		}
+		runCommand("set minSpeed " + ofToString(e.value, 6));
 	});
 	maxSpeedSlider = robotConstantsFolder->addSlider("maxSpeed", 0, 1024);
-	maxSpeedSlider->setValue(r01->maxSpeed);
+	maxSpeedSlider->setValue(defaults.maxSpeed);
 	maxSpeedSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
-		for (auto &p : robotsById) {
-			Robot &r = *p.second;
-			r.maxSpeed = e.value;
-		}
+		runCommand("set maxSpeed " + ofToString(e.value, 6));
 	});
 	speedRampSlider = robotConstantsFolder->addSlider("speedRamp", 0, 1);
-	speedRampSlider->setValue(r01->speedRamp);
+	speedRampSlider->setValue(defaults.speedRamp);
 	speedRampSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
-		for (auto &p : robotsById) {
-			Robot &r = *p.second;
-			r.speedRamp = e.value;
-		}
+		runCommand("set speedRamp " + ofToString(e.value, 6));
+	});
+	maxAccelSlider = robotConstantsFolder->addSlider("maxAccel", 0, 2);
+	maxAccelSlider->setValue(defaults.maxAccel);
+	maxAccelSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set maxAccel " + ofToString(e.value, 6));
+	});
+	maxJerkSlider = robotConstantsFolder->addSlider("maxJerk", 0, 20);
+	maxJerkSlider->setValue(defaults.maxJerk);
+	maxJerkSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set maxJerk " + ofToString(e.value, 6));
 	});
 
-	auto pidListener = [this](ofxDatGuiSliderEvent e) {
-		for (auto &p : robotsById) {
-			Robot &r = *p.second;
+	mpcToggle = robotConstantsFolder->addToggle("MPC line following");
+	mpcToggle->setChecked(defaults.lineController == LC_MPC);
+	mpcToggle->onToggleEvent([this](ofxDatGuiToggleEvent e) {
+		runCommand("set mpc " + ofToString(e.checked ? 1 : 0));
+	});
 
-			r.updatePID(kpSlider->getValue(),
-						kiSlider->getValue(),
-						kdSlider->getValue(),
-						kMaxISlider->getValue());
-		}
-	};
+	balanceToggle = gui->addToggle("Balance path types");
+	balanceToggle->setChecked(balanceLoad);
+	balanceToggle->onToggleEvent([this](ofxDatGuiToggleEvent e) {
+		runCommand("balance " + ofToString(e.checked ? 1 : 0));
+	});
 
 	// event listeners
-	kpSlider->onSliderEvent(pidListener);
-	kiSlider->onSliderEvent(pidListener);
-	kdSlider->onSliderEvent(pidListener);
-	kMaxISlider->onSliderEvent(pidListener);
+	kpSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set kp " + ofToString(e.value, 6));
+	});
+	kiSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set ki " + ofToString(e.value, 6));
+	});
+	kdSlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set kd " + ofToString(e.value, 6));
+	});
+	kMaxISlider->onSliderEvent([this](ofxDatGuiSliderEvent e) {
+		runCommand("set maxI " + ofToString(e.value, 6));
+	});
+
+	ofxDatGuiButton *loadProfileButton = robotConstantsFolder->addButton("Load Tuning Profile");
+	loadProfileButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
+		ofFileDialogResult openFileResult = ofSystemLoadDialog("Select a tuning profile!");
+		if (openFileResult.bSuccess) {
+			runCommand("profile " + openFileResult.getPath());
+		}
+	});
+
+#if PROFILING
+	profileFolder = gui->addFolder("Timings p50 / p99 / max (us)");
+	ofxDatGuiButton *dumpTimingsButton = profileFolder->addButton("Dump Timings");
+	dumpTimingsButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
+		Profiler::dump(ofToDataPath("timings-" + ofGetTimestampString("%Y-%m-%d-%H-%M-%S") + ".txt", true));
+	});
+	ofxDatGuiButton *resetTimingsButton = profileFolder->addButton("Reset Timings");
+	resetTimingsButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
+		Profiler::resetAll();
+	});
+	lastProfileGuiTime = 0;
+#endif
 
 	gui->addBreak();
 
     ofxDatGuiButton *reloadMapButton = gui->addButton("Reset Map");
 	reloadMapButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
-		for (auto &i : currentMap->mapPathStore) {
-			for (auto &j : i.second) {
-				j.claimed = false;
-				j.drawn = false;
-			}
-		}
+		runCommand("reset-map");
 	});
     
     ofxDatGuiButton *loadNewMapButton = gui->addButton("Load New Map");
@@ -205,8 +295,26 @@ void ofApp::setup() {
 		}
     });
     
+	ofxDatGuiButton *reloadFleetButton = gui->addButton("Reload Fleet");
+	reloadFleetButton->onButtonEvent([this](ofxDatGuiButtonEvent e) {
+		loadFleet(kFleetPath);
+	});
+
 	gui->addFRM();
 
+	currentMap = new Map(kMapWidthM, kMapHeightM, kMapOffsetXM, kMapOffsetYM, kCropBox);
+
+	if (replayClock) {
+		// The log loads its own map
+		setupMapGui();
+		rpiState = RPI_UNKNOWN;
+		setState(MR_STOPPED);
+		if (!startReplay(replayPath, replayClock)) {
+			ofExit(1);
+		}
+		return;
+	}
+
 	// Listen for messages from camera
 	oscReceiver.setup( PORT );
 
@@ -218,8 +326,8 @@ void ofApp::setup() {
 	robotReceiver.Bind(5101);
 	robotReceiver.SetNonBlocking(true);
 
-	currentMap = new Map(kMapWidthM, kMapHeightM, kMapOffsetXM, kMapOffsetYM, kCropBox);
-	pathGui = NULL;
+	lastMetricsTime = -kMetricsIntervalSec;
+	metricsServer.start(kMetricsPort);
 
 	string mostRecent = currentMap->getMostRecentMap(kDownloadPath);
 	if (mostRecent.size() > 0) {
@@ -230,13 +338,180 @@ void ofApp::setup() {
 	}
 	loadMap(mapPath);
 
+	// A replay gets new maps from its merge-map commands
+	if (!replayClock) {
+		watcher.start(kDownloadPath, mapPath);
+	}
+
+	rpiState = RPI_UNKNOWN;
+	setState(MR_STOPPED);
+}
+
+void ofApp::setupHeadless(Clock *c, SimClock *sc, Simulator *sim) {
+	headless = true;
+	clock = c;
+	simClock = sc;
+	simulator = sim;
+	replayer = NULL;
+	replayClock = NULL;
+	journaling = false;
+
+	collisions.configure(kRobotSafetyDiameter, kRobotOuterSafetyDiameter, kCollisionHorizonSec, kMaxRobotSpeedMps);
+	reservations.configure(kRobotOuterSafetyDiameter);
+	balanceLoad = true;
+	lastRetreatTime = -kRetreatCooldownSec;
+
+	gui = NULL;
+	pathGui = NULL;
+
+	currentMap = new Map(kMapWidthM, kMapHeightM, kMapOffsetXM, kMapOffsetYM, kCropBox);
+	resetJobCounters();
+
 	rpiState = RPI_UNKNOWN;
+	rpiLastStateMessageTime = 0;
 	setState(MR_STOPPED);
 }
 
+void ofApp::addRobot(Robot *r) {
+	robotsById[r->id] = r;
+	robotsByMarker[r->markerId] = r;
+}
+
+void ofApp::addRobotGui(Robot &r) {
+	const int robotId = r.id;
+	RobotGui &rGui = robotGuis[robotId];
+
+	rGui.folder = gui->addFolder(ofToString(r.name.c_str()) + " (" + ofToString(r.id) + ")", ofColor::white);
+	rGui.folder->expand();
+
+	rGui.stateLabel = rGui.folder->addLabel(r.stateDescription());
+	rGui.posLabel = rGui.folder->addLabel(r.positionString());
+	rGui.lastMessageLabel = rGui.folder->addLabel("");
+	rGui.advanceButton = rGui.folder->addButton("Skip path");
+	rGui.advanceButton->onButtonEvent([robotId, this](ofxDatGuiButtonEvent e) {
+		runCommand("skip " + ofToString(robotId));
+	});
+
+	gui->addBreak();
+}
+
+// Where the simulator puts robot n: opposite corners first, then the other
+// two, then the same again further in
+static ofVec2f simStartPosition(int n) {
+	const float angle = 180 * (n % 2) + 90 * ((n / 2) % 2);
+	return ofVec2f(-0.35).getRotated(angle) / (1 + n / 4);
+}
+
+bool ofApp::loadFleet(const string &path) {
+	ofxJSONElement json;
+	if (!json.open(path)) {
+		cout << "Couldn't load fleet from " << path << endl;
+		return false;
+	}
+
+	// Recorded inline, so a replay gets the robots the run had
+	string config = json.getRawString(false);
+	config.erase(config.find_last_not_of("\n") + 1);
+	runCommand("fleet " + config);
+	return true;
+}
+
+void ofApp::addFleet(const vector<RobotConfig> &fleet) {
+	int added = 0;
+	for (const RobotConfig &c : fleet) {
+		Robot *r;
+		if (robotsById.find(c.id) != robotsById.end()) {
+			r = robotsById[c.id];
+		} else if (robotsByMarker.find(c.markerId) != robotsByMarker.end()) {
+			cout << "Can't add " << c.name << ", marker " << c.markerId << " is already in use" << endl;
+			continue;
+		} else {
+			const int n = robotsById.size();
+			r = new Robot(c.id, c.markerId, c.name, clock);
+			// Off the canvas until the camera sees it
+			r->planePos = ofVec2f(2 + kRobotOuterSafetyDiameter * n);
+			addRobot(r);
+
+			if (currentMap) {
+				for (auto &pathType : currentMap->pathTypes) {
+					r->addPathType(pathType);
+				}
+			}
+			if (simulator) {
+				simulator->addRobot(r->id, r->markerId, simStartPosition(n), 0);
+				r->simulator = simulator;
+			}
+			if (gui) {
+				addRobotGui(*r);
+			}
+			cout << "Added robot " << r->name << " (" << r->id << ")" << endl;
+			added++;
+		}
+
+		// A replay must never move the real robots
+		if (replayPath.empty() && !c.ip.empty() && (!r->sender || r->ip != c.ip || r->port != c.port)) {
+			r->setCommunication(c.ip, c.port, &robotSender);
+		}
+	}
+
+	if (added > 0 && pathGui) {
+		setupMapGui();
+	}
+}
+
+void ofApp::stepSimulation(float dt) {
+	MR_PROFILE_SCOPE("ofApp::stepSimulation");
+	if (simClock) {
+		simClock->advance(dt);
+	}
+	simulator->step(dt);
+
+	for (auto &json : simulator->takeCameraMessages()) {
+		handleCameraMessage(json);
+	}
+	for (auto &message : simulator->takeRobotMessages()) {
+		const int length = min(message.length(), sizeof(robotMessage) - 1);
+		memcpy(robotMessage, message.data(), length);
+		handleRobotMessage(robotMessage, length);
+	}
+}
+
 void ofApp::loadMap(const string &newMapPath) {
+	recorder.record(clock->now(), IN_MAP_LOAD, newMapPath);
+
+	mapLoader.cancel();
 	mapPath = newMapPath;
-	currentMap->loadMap(mapPath);
+	const string journalDir = ofToDataPath(kJournalDir + "/" + ofFilePath::getBaseName(mapPath), true);
+	if (TileStore::exists(mapPath)) {
+		currentMap->openTiles(mapPath);
+	} else {
+		// A version merged into an older one keeps the older one's frame
+		uint64_t journaled;
+		MapFrame frame;
+		if (journaling && ProgressJournal::readFrame(journalDir, journaled, frame)) {
+			currentMap->loadMap(mapPath, &frame);
+			if (currentMap->fingerprint() != journaled) {
+				currentMap->loadMap(mapPath);
+			}
+		} else {
+			currentMap->loadMap(mapPath);
+		}
+		if (currentMap->getPathCount() > kTiledMapSegments) {
+			currentMap->writeTiles(ofToDataPath(kTileDir + "/" + ofFilePath::getBaseName(mapPath), true), kTileSizeM);
+		}
+	}
+	robotPaths.clear();
+	resetJobCounters();
+	reservations.clear();
+
+	if (journaling) {
+		set<int> drawn;
+		if (journal.open(journalDir, currentMap->fingerprint(), currentMap->getFrame(), drawn)) {
+			currentMap->markDrawn(drawn);
+			cout << "Resuming with " << drawn.size() << " of " << currentMap->getActivePathCount() << " segments drawn" << endl;
+		}
+	}
+	deferStartTime.clear();
 
 	for (auto &p : robotsById) {
 		int id = p.first;
@@ -249,7 +524,265 @@ void ofApp::loadMap(const string &newMapPath) {
 		}
 	}
 
-	setupMapGui();
+	if (!headless) {
+		setupMapGui();
+	}
+}
+
+void ofApp::mergeMap(const string &newMapPath) {
+	if (currentMap->isTiled() || currentMap->getPathCount() > kTiledMapSegments) {
+		cout << "Map is too large to merge, loading " << newMapPath << " instead" << endl;
+		loadMap(newMapPath);
+		return;
+	}
+	mapLoader.start(newMapPath, *currentMap);
+}
+
+// Recorded once the new version is loaded, so a replay waits for it here
+void ofApp::finishMerge(const string &newMapPath) {
+	Map *incoming = mapLoader.take(true);
+	if (incoming == NULL || mapLoader.path != newMapPath) {
+		cout << "No loaded map to merge for " << newMapPath << endl;
+		delete incoming;
+		return;
+	}
+
+	map<int, int> claimed, renamed;
+	for (auto &p : robotPaths) {
+		if (p.second != NULL) claimed[p.first] = p.second->id;
+	}
+	const set<string> oldTypes(currentMap->pathTypes.begin(), currentMap->pathTypes.end());
+	MergeStats stats;
+	const bool merged = currentMap->mergeMap(*incoming, renamed, stats);
+	delete incoming;
+	if (!merged) {
+		return;
+	}
+	mapPath = newMapPath;
+	cout << "Merged " << newMapPath << ": " << stats.kept << " segments kept, " << stats.covered << " already drawn, " << stats.added << " added, " << stats.removed << " removed" << endl;
+
+	// Robots carry on with what they'd claimed, under its new id
+	for (auto &p : claimed) {
+		auto id = renamed.find(p.second);
+		robotPaths[p.first] = id != renamed.end() ? currentMap->pathById(id->second) : NULL;
+	}
+
+	// Every robot draws new path types, as after loading
+	for (auto &p : robotsById) {
+		for (auto &pathType : currentMap->pathTypes) {
+			if (!oldTypes.count(pathType)) p.second->addPathType(pathType);
+		}
+	}
+
+	// Progress so far goes into the new map's journal, with the frame it
+	// was loaded in so a restart loads it the same way
+	if (journaling) {
+		set<int> drawn;
+		if (journal.open(ofToDataPath(kJournalDir + "/" + ofFilePath::getBaseName(mapPath), true), mapLoader.fingerprint, currentMap->getFrame(), drawn)) {
+			for (auto &p : currentMap->mapPathStore) {
+				for (auto &path : p.second) {
+					if (path.drawn) journal.record(J_DRAWN, path.id);
+				}
+			}
+		}
+	}
+
+	if (!headless) {
+		setupMapGui();
+	}
+}
+
+void ofApp::runCommand(const string &command) {
+	recorder.record(clock->now(), IN_COMMAND, command);
+
+	vector<string> args = ofSplitString(command, " ");
+	const string &name = args[0];
+
+	if (name == "state" && args.size() == 2) {
+		setState((MaproomState)ofToInt(args[1]));
+	} else if (name == "skip" && args.size() == 2) {
+		const int robotId = ofToInt(args[1]);
+		if (robotsById.find(robotId) != robotsById.end()) {
+			robotsById[robotId]->setState(R_DONE_DRAWING);
+		}
+	} else if (name == "reset-map") {
+		currentMap->resetPaths();
+		journal.record(J_RESET, -1);
+		resetJobCounters();
+		// A version being loaded would bring back what was drawn
+		if (mapLoader.isLoading() || mapLoader.isReady()) {
+			mapLoader.start(mapLoader.path, *currentMap);
+		}
+	} else if (name == "set" && args.size() == 3) {
+		const string &param = args[1];
+		const float value = ofToFloat(args[2]);
+		for (auto &p : robotsById) {
+			Robot &r = *p.second;
+			if (param == "kp") {
+				r.updatePID(value, r.targetLineKi, r.targetLineKd, r.targetLineMaxI);
+			} else if (param == "ki") {
+				r.updatePID(r.targetLineKp, value, r.targetLineKd, r.targetLineMaxI);
+			} else if (param == "kd") {
+				r.updatePID(r.targetLineKp, r.targetLineKi, value, r.targetLineMaxI);
+			} else if (param == "maxI") {
+				r.updatePID(r.targetLineKp, r.targetLineKi, r.targetLineKd, value);
+			} else if (param == "minSpeed") {
+				r.minSpeed = value;
+			} else if (param == "maxSpeed") {
+				r.maxSpeed = value;
+			} else if (param == "speedRamp") {
+				r.speedRamp = value;
+			} else if (param == "maxAccel") {
+				r.maxAccel = value;
+			} else if (param == "maxJerk") {
+				r.maxJerk = value;
+			} else if (param == "mpc") {
+				r.lineController = value > 0 ? LC_MPC : LC_PID;
+			}
+		}
+	} else if (name == "profile" && args.size() > 1) {
+		loadTuningProfile(command.substr(name.size() + 1));
+	} else if (name == "path" && args.size() > 2) {
+		// path <0|1> <type>, types can contain spaces
+		const string pathType = command.substr(name.size() + args[1].size() + 2);
+		currentMap->setPathActive(pathType, args[1] == "1");
+	} else if (name == "path-robot" && args.size() > 3) {
+		// path-robot <robot id> <0|1> <type>
+		const int robotId = ofToInt(args[1]);
+		const string pathType = command.substr(name.size() + args[1].size() + args[2].size() + 3);
+		if (robotsById.find(robotId) != robotsById.end()) {
+			Robot &r = *robotsById[robotId];
+			if (args[2] == "1") {
+				r.addPathType(pathType);
+			} else {
+				r.removePathType(pathType);
+			}
+		}
+	} else if (name == "fleet" && args.size() > 1) {
+		// fleet <config json>
+		ofxJSONElement json;
+		vector<RobotConfig> fleet;
+		if (json.parse(command.substr(name.size() + 1)) && parseFleet(json, fleet)) {
+			addFleet(fleet);
+			parseStagingPoints(json, stagingPoints);
+		} else {
+			cout << "Bad fleet config" << endl;
+		}
+	} else if (name == "merge-map" && args.size() > 1) {
+		mergeMap(command.substr(name.size() + 1));
+	} else if (name == "merge-ready" && args.size() > 1) {
+		finishMerge(command.substr(name.size() + 1));
+	} else if (name == "balance" && args.size() == 2) {
+		balanceLoad = args[1] == "1";
+	} else if (name == "rpi-state" && args.size() == 2) {
+		if (!replayer) {
+			ofxOscMessage m;
+			m.setAddress("/state");
+			m.addIntArg(ofToInt(args[1]));
+			oscToRPi.sendMessage(m, false);
+		}
+	} else {
+		cout << "Unknown command: " << command << endl;
+	}
+}
+
+// Whether the log sets up its robots before its first frame
+static bool replayHasFleet(const string &path) {
+	InputReplayer log;
+	InputRecord record;
+	if (!log.open(path)) {
+		return false;
+	}
+	while (log.next(record) && record.type != IN_FRAME) {
+		if (record.type == IN_COMMAND && record.data.compare(0, 6, "fleet ") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ofApp::startReplay(const string &path, ReplayClock *c) {
+	replayer = new InputReplayer();
+	if (!replayer->open(path)) {
+		delete replayer;
+		replayer = NULL;
+		return false;
+	}
+
+	// Logs from before fleets were recorded get today's
+	if (!replayHasFleet(path)) {
+		cout << "No fleet in " << path << ", using " << kFleetPath << endl;
+		loadFleet(kFleetPath);
+	}
+
+	replayClock = c;
+	replayOffset = ofGetElapsedTimef() - replayer->nextTime();
+	cout << "Replaying inputs from " << path << endl;
+	return true;
+}
+
+bool ofApp::replayFrame() {
+	InputRecord record;
+	while (replayer->next(record)) {
+		replayClock->seek(record.time);
+
+		switch (record.type) {
+			case IN_FRAME:
+				replayClock->frame = InputReplayer::frameNumber(record);
+				commandRobots();
+				return true;
+			case IN_CV:
+				handleCameraMessage(record.data);
+				break;
+			case IN_STATE:
+				handleStateMessage(record.data);
+				break;
+			case IN_ROBOT: {
+				const int length = min(record.data.size(), sizeof(robotMessage) - 1);
+				memcpy(robotMessage, record.data.data(), length);
+				handleRobotMessage(robotMessage, length);
+				break;
+			}
+			case IN_COMMAND:
+				runCommand(record.data);
+				break;
+			case IN_MAP_LOAD:
+				loadMap(record.data);
+				break;
+			default:
+				break;
+		}
+	}
+	return false;
+}
+
+void ofApp::loadTuningProfile(const string &path) {
+	TuningParams params;
+	if (!TuningHarness::loadProfile(path, params)) {
+		cout << "Couldn't load tuning profile " << path << endl;
+		return;
+	}
+
+	for (auto &p : robotsById) {
+		TuningHarness::applyParams(*p.second, params);
+	}
+
+	if (headless) {
+		cout << "Loaded tuning profile " << path << endl;
+		return;
+	}
+
+	kpSlider->setValue(params.kp);
+	kiSlider->setValue(params.ki);
+	kdSlider->setValue(params.kd);
+	kMaxISlider->setValue(params.maxI);
+	minSpeedSlider->setValue(params.minSpeed);
+	maxSpeedSlider->setValue(params.maxSpeed);
+	speedRampSlider->setValue(params.speedRamp);
+	maxAccelSlider->setValue(params.maxAccel);
+	maxJerkSlider->setValue(params.maxJerk);
+
+	cout << "Loaded tuning profile " << path << endl;
 }
 
 void ofApp::setupMapGui() {
@@ -268,6 +801,7 @@ void ofApp::setupMapGui() {
 	pathLabel = pathGui->addLabel("Total Active Paths: " + ofToString(currentMap->getActivePathCount()));
 	pathStatusLabel = pathGui->addLabel("");
 	drawnPathLabel = pathGui->addLabel("");
+	fastPathLabel = pathGui->addLabel("");
 
 	pathGui->addBreak();
 
@@ -279,7 +813,7 @@ void ofApp::setupMapGui() {
 		pGui.toggle = pathGui->addToggle("PATH: " + ofToString(pathType) + " \t\t- " + ofToString(currentMap->getPathCount(pathType)));
 		pGui.toggle->setChecked(true);
 		pGui.toggle->onToggleEvent([&pathType, this](ofxDatGuiToggleEvent e) {
-			currentMap->setPathActive(pathType, e.checked);
+			runCommand("path " + ofToString(e.checked ? 1 : 0) + " " + pathType);
 		});
 
 		pGui.folder = pathGui->addFolder("Robot Select");
@@ -287,13 +821,11 @@ void ofApp::setupMapGui() {
 			Robot &r = *pair.second;
 
 			ofxDatGuiToggle *t = pGui.folder->addToggle(r.name + " (" + ofToString(r.id) + ")");
-			t->setChecked(true);
-			t->onToggleEvent([&r, &pathType](ofxDatGuiToggleEvent e) {
-				if (e.checked) {
-					r.addPathType(pathType);
-				} else {
-					r.removePathType(pathType);
-				}
+			t->setChecked(r.pathTypes.count(pathType) > 0);
+			pGui.robotToggles[r.id] = t;
+			const int robotId = r.id;
+			t->onToggleEvent([robotId, &pathType, this](ofxDatGuiToggleEvent e) {
+				runCommand("path-robot " + ofToString(robotId) + " " + ofToString(e.checked ? 1 : 0) + " " + pathType);
 			});
 		}
 
@@ -304,7 +836,21 @@ void ofApp::setupMapGui() {
 	pathGui->addFooter();
 }
 
+void ofApp::resetJobCounters() {
+	fastPathCount = 0;
+	fastPathSavedSec = 0;
+	safetyRetreats = 0;
+	safetyStops = 0;
+	safetyYields = 0;
+	reservationDeferrals = 0;
+	balancer.steals = 0;
+}
+
 void ofApp::exit() {
+	metricsServer.stop();
+	journal.close();
+	currentMap->flushTiles();
+
 	for (auto &p : robotsById) {
 		int id = p.first;
 		Robot &r = *p.second;
@@ -313,62 +859,95 @@ void ofApp::exit() {
 }
 
 void ofApp::setState(MaproomState newState) {
-	startButton->setEnabled(newState != MR_RUNNING);
-	pauseButton->setEnabled(newState != MR_PAUSED);
-	stopButton->setEnabled(newState != MR_STOPPED);
-
-	static const ofColor enabled(50, 50, 100), disabled(50, 50, 50);
-	startButton->setBackgroundColor(newState == MR_RUNNING ? enabled : disabled);
-	pauseButton->setBackgroundColor(newState == MR_PAUSED ? enabled : disabled);
-	stopButton->setBackgroundColor(newState == MR_STOPPED ? enabled : disabled);
+	if (!headless) {
+		startButton->setEnabled(newState != MR_RUNNING);
+		pauseButton->setEnabled(newState != MR_PAUSED);
+		stopButton->setEnabled(newState != MR_STOPPED);
+
+		static const ofColor enabled(50, 50, 100), disabled(50, 50, 50);
+		startButton->setBackgroundColor(newState == MR_RUNNING ? enabled : disabled);
+		pauseButton->setBackgroundColor(newState == MR_PAUSED ? enabled : disabled);
+		stopButton->setBackgroundColor(newState == MR_STOPPED ? enabled : disabled);
+	}
 
 	state = newState;
-	stateStartTime = ofGetElapsedTimef();
+	stateStartTime = clock->now();
 }
 
 //--------------------------------------------------------------
 void ofApp::update() {
-#if SIMULATING
-	for (auto &p : robotsById) {
-		p.second->updateSimulation(ofGetLastFrameTime());
+	MR_PROFILE_SCOPE("ofApp::update");
+
+	if (replayer) {
+		if (replayFast) {
+			const float budgetEnd = ofGetElapsedTimef() + kFastReplayBudgetSec;
+			while (ofGetElapsedTimef() < budgetEnd && replayFrame()) {}
+		} else {
+			while (!replayer->done() && replayer->nextTime() + replayOffset <= ofGetElapsedTimef()) {
+				replayFrame();
+			}
+		}
+		updateGui();
+		return;
 	}
+
+#if SIMULATING
+	stepSimulation(ofGetLastFrameTime() * kSimulationSpeed);
 #endif
 	handleOSC();
 	receiveFromRobots();
+	const string newMap = watcher.poll();
+	if (!newMap.empty()) {
+		runCommand("merge-map " + newMap);
+	}
+	// A replay finishes merges at its merge-ready commands
+	if (!replayClock && mapLoader.isReady()) {
+		runCommand("merge-ready " + mapLoader.path);
+	}
+	recorder.recordFrame(clock->now(), clock->frameNum());
 	commandRobots();
+	robotSender.flush();
 	updateGui();
+	publishMetrics();
 }
 
 void ofApp::receiveFromRobots() {
-	int nChars = robotReceiver.Receive(robotMessage, 1024);
+	MR_PROFILE_SCOPE("ofApp::receiveFromRobots");
+	int nChars = robotReceiver.Receive(robotMessage, 1023);
 	if (nChars > 0) {
-		robotMessage[nChars] = 0;
+		handleRobotMessage(robotMessage, nChars);
+	}
+}
 
-		if (robotMessage[0] == 'R' && robotMessage[1] == 'B') {
-			char val = robotMessage[4];
-			robotMessage[4] = 0;
-			int robotId = atoi(robotMessage + 2);
-			robotMessage[4] = val;
+void ofApp::handleRobotMessage(char *message, int length) {
+	recorder.record(clock->now(), IN_ROBOT, message, length);
+	message[length] = 0;
 
-			if (robotsById.find(robotId) == robotsById.end()) {
-				cout << "Unknown robot: " << robotId << endl;
-				return;
-			}
+	if (message[0] == 'R' && message[1] == 'B') {
+		char val = message[4];
+		message[4] = 0;
+		int robotId = atoi(message + 2);
+		message[4] = val;
 
-			Robot &r = *robotsById[robotId];
+		if (robotsById.find(robotId) == robotsById.end()) {
+			cout << "Unknown robot: " << robotId << endl;
+			return;
+		}
 
-			if (robotMessage[4] == 'H' && robotMessage[5] == 'B') {
-				r.gotHeartbeat();
-			} else {
-				cout << "Got unknown message from robot " << robotId << ": " << robotMessage + 4 << endl;
-			}
+		Robot &r = *robotsById[robotId];
+
+		if (message[4] == 'H' && message[5] == 'B') {
+			r.gotHeartbeat();
 		} else {
-			cout << "Unknown robot message: " << robotMessage << endl;
+			cout << "Got unknown message from robot " << robotId << ": " << message + 4 << endl;
 		}
+	} else {
+		cout << "Unknown robot message: " << message << endl;
 	}
 }
 
 void ofApp::handleOSC() {
+	MR_PROFILE_SCOPE("ofApp::handleOSC");
 	while( oscReceiver.hasWaitingMessages() )
 	{
 		// get the next message
@@ -378,40 +957,47 @@ void ofApp::handleOSC() {
 		// check for mouse moved message
 		if ( m.getAddress() == "/cv" )
 		{
-			string msg = m.getArgAsString(0);
-			jsonMsg.parse(msg);
-
-			int nIds = jsonMsg["ids"].size();
-			for (int i = 0; i < nIds; ++i) {
-				int markerId = jsonMsg["ids"][i].asInt();
-				ofVec2f pos(jsonMsg["pos"][i][0].asFloat(), jsonMsg["pos"][i][1].asFloat());
-				ofVec2f up(jsonMsg["up"][i][0].asFloat(), jsonMsg["up"][i][1].asFloat());
-				ofVec2f rawPos(jsonMsg["raw_pos"][i][0].asFloat(), jsonMsg["raw_pos"][i][1].asFloat());
-				ofVec2f rawUp(jsonMsg["raw_up"][i][0].asFloat(), jsonMsg["raw_up"][i][1].asFloat());
-
-				if (robotsByMarker.find(markerId) != robotsByMarker.end()) {
-					robotsByMarker[markerId]->updateCamera(pos, up);
-				}
-
-				if (markersById.find(markerId) == markersById.end()) {
-					markersById[markerId] = ArucoMarker(markerId);
-				}
-				markersById[markerId].updateCamera(rawPos, rawUp);
-			}
+			handleCameraMessage(m.getArgAsString(0));
 		} else if ( m.getAddress() == "/state" ) {
-			string msg = m.getArgAsString(0);
-			jsonMsg.parse(msg);
-			int state = jsonMsg["state"].asInt();
-			if (state >= 0 && state < N_RPI_STATES) {
-				rpiState = (RPiState)state;
-			} else {
+			handleStateMessage(m.getArgAsString(0));
+		}
+	}
+}
 
-			}
+void ofApp::handleCameraMessage(const string &msg) {
+	recorder.record(clock->now(), IN_CV, msg);
+	jsonMsg.parse(msg);
 
-			rpiLastStateMessageTime = ofGetElapsedTimef();
+	int nIds = jsonMsg["ids"].size();
+	for (int i = 0; i < nIds; ++i) {
+		int markerId = jsonMsg["ids"][i].asInt();
+		ofVec2f pos(jsonMsg["pos"][i][0].asFloat(), jsonMsg["pos"][i][1].asFloat());
+		ofVec2f up(jsonMsg["up"][i][0].asFloat(), jsonMsg["up"][i][1].asFloat());
+		ofVec2f rawPos(jsonMsg["raw_pos"][i][0].asFloat(), jsonMsg["raw_pos"][i][1].asFloat());
+		ofVec2f rawUp(jsonMsg["raw_up"][i][0].asFloat(), jsonMsg["raw_up"][i][1].asFloat());
 
+		if (robotsByMarker.find(markerId) != robotsByMarker.end()) {
+			robotsByMarker[markerId]->updateCamera(pos, up);
 		}
+
+		if (markersById.find(markerId) == markersById.end()) {
+			markersById[markerId] = ArucoMarker(markerId, clock);
+		}
+		markersById[markerId].updateCamera(rawPos, rawUp);
+	}
+}
+
+void ofApp::handleStateMessage(const string &msg) {
+	recorder.record(clock->now(), IN_STATE, msg);
+	jsonMsg.parse(msg);
+	int state = jsonMsg["state"].asInt();
+	if (state >= 0 && state < N_RPI_STATES) {
+		rpiState = (RPiState)state;
+	} else {
+
 	}
+
+	rpiLastStateMessageTime = clock->now();
 }
 
 void ofApp::unclaimPath(int robotId) {
@@ -419,72 +1005,369 @@ void ofApp::unclaimPath(int robotId) {
 		MapPath *mp = robotPaths[robotId];
 		if (mp != NULL && mp->claimed && !mp->drawn) {
 			mp->claimed = false;
+			journal.record(J_UNCLAIMED, mp->id);
 		}
 		robotPaths.erase(robotPaths.find(robotId));
 	}
+
+	if (robotsById.find(robotId) != robotsById.end()) {
+		reservations.park(robotId, robotsById[robotId]->avgPlanePos, clock->now());
+	}
 }
 
-void ofApp::sendRobotsToCorners() {
-	int robotsAssigned = 0;
+// Corridors r sweeps positioning to and drawing mp, with the nearer end first
+static vector<Corridor> plannedCorridors(const Robot &r, const MapPath &mp, float now) {
+	ofVec2f start = mp.segment.start, end = mp.segment.end;
+	if (start.distance(r.avgPlanePos) > end.distance(r.avgPlanePos)) {
+		swap(start, end);
+	}
 
-	vector<ofVec2f> corners = { kRetreatCornerBox.getTopLeft(), kRetreatCornerBox.getTopRight(), kRetreatCornerBox.getBottomRight(), kRetreatCornerBox.getBottomLeft() };
-	vector<bool> taken = { false, false, false, false };
-	while (robotsAssigned < robotsById.size()) {
-		float minDist = 10000000;
-		int whichCorner = -1;
-		int whichRobot = -1;
+	const float speed = r.maxSpeed / r.speedUnitsPerMps * kPlanningSpeedFactor;
+	const float drawStart = now + r.avgPlanePos.distance(start) / speed + kPlanningSettleSec;
+	const float drawEnd = drawStart + start.distance(end) / speed;
+	return { { r.avgPlanePos, start, now, drawStart }, { start, end, drawStart, drawEnd } };
+}
 
-		for (auto &p : robotsById) {
-			Robot &r = *p.second;
+MapPath* ofApp::claimNextPath(Robot &r) {
+	// A robot that lost track of its segment, e.g. dropping out of
+	// positioning, gives it back rather than leaking the claim
+	unclaimPath(r.id);
 
-			for (int cornerId = 0; cornerId < corners.size(); ++cornerId) {
-				if (taken[cornerId]) continue;
+	const float now = clock->now();
+	const bool waitedLong = deferStartTime.find(r.id) != deferStartTime.end() && now - deferStartTime[r.id] > kReservationWaitSec;
 
-				float d = corners[cornerId].distance(r.planePos);
-				if (d < minDist) {
-					minDist = d;
-					whichCorner = cornerId;
-					whichRobot = p.first;
-				}
-			}
+	bool deferred = false;
+	MapPath *mp = currentMap->nextPath(r.avgPlanePos, r.id, r.lastHeading, r.pathTypes, [&](const MapPath &candidate) {
+		if (reservations.conflict(r.id, plannedCorridors(r, candidate, now), now, waitedLong) >= 0) {
+			deferred = true;
+			return false;
 		}
+		return true;
+	});
+	robotPaths[r.id] = mp;
 
-		if (whichRobot < 0 || whichCorner < 0) {
-			cout << "Didn't find a corner, abort" << endl;
-			break;
+	if (mp == NULL) {
+		reservations.park(r.id, r.avgPlanePos, now);
+		if (deferred && deferStartTime.insert(make_pair(r.id, now)).second) {
+			reservationDeferrals++;
 		}
+		return NULL;
+	}
+	deferStartTime.erase(r.id);
+	reservations.reserve(r.id, plannedCorridors(r, *mp, now));
 
-		robotsById[whichRobot]->navigateTo(corners[whichCorner]);
-		taken[whichCorner] = true;
-		robotsAssigned++;
+	if (mp->segment.start.distance(r.avgPlanePos) > mp->segment.end.distance(r.avgPlanePos)) {
+		ofVec2f tmp = mp->segment.start;
+		mp->segment.start = mp->segment.end;
+		mp->segment.end = tmp;
 	}
+
+	mp->claimed = true;
+	journal.record(J_CLAIMED, mp->id);
+	r.lastHeading = atan2(mp->segment.end.x - mp->segment.start.x, mp->segment.end.y - mp->segment.start.y)*180/3.14159;
+	return mp;
 }
 
-void ofApp::commandRobots() {
+void ofApp::avoidCollisions() {
+	MR_PROFILE_SCOPE("ofApp::avoidCollisions");
+	const float now = clock->now();
+
+	vector<CollisionAgent> agents;
 	for (auto &p : robotsById) {
-		int id = p.first;
 		Robot &r = *p.second;
+		const bool moving = r.state == R_POSITIONING || r.state == R_DRAWING;
+
+		CollisionAgent a;
+		a.id = r.id;
+		a.pos = r.planePos;
+		a.vel = r.avgPlaneVel;
+		a.moving = moving;
+		a.target = r.targetPlanePos;
+		// Keep pens moving, positioning robots can wait
+		a.priority = r.state == R_DRAWING ? 2 : (moving ? 1 : 0);
+		if (r.state != R_POSITIONING) {
+			separating.erase(r.id);
+		}
+		a.separating = separating.count(r.id) > 0;
+		agents.push_back(a);
+	}
 
-		for (auto &p2 : robotsById) {
-			int id2 = p2.first;
-			if (id == id2) continue;
+	bool deadlocked = false;
+	for (auto &p : collisions.update(agents)) {
+		const int id = p.first;
+		const CollisionResult &result = p.second;
+		Robot &r = *robotsById[id];
+
+		// Count each time robots get too close, not each frame they stay there
+		if (!result.inDanger) {
+			robotsInDanger.erase(id);
+			dangerStartTime.erase(id);
+		} else if (robotsInDanger.insert(id).second) {
+			safetyStops++;
+			dangerStartTime[id] = now;
+			cout << "Robot " << id << " inside the safety zone of another robot" << endl;
+		} else if (now - dangerStartTime[id] > kDeadlockSec) {
+			deadlocked = true;
+		}
 
-			Robot &r2 = *p2.second;
+		const bool moving = r.state == R_POSITIONING || r.state == R_DRAWING;
+		if (result.speedScale <= 0 && moving) {
+			if (holdStartTime.find(id) == holdStartTime.end()) {
+				holdStartTime[id] = now;
+				safetyYields++;
+			}
+			lastHoldTime[id] = now;
 
-			float dist = r.planePos.distance(r2.planePos);
-			if (dist < kRobotSafetyDiameter) {
-				// Too close! Stop entirely.
-				r.stop();
-				r2.stop();
-				cout << "Stopping both robots, way too close " << dist << endl;
-			} else if (dist < kRobotOuterSafetyDiameter) {
-				unclaimPath(id);
-				unclaimPath(id2);
+			// Inside the inner zone the other robot is held too, so don't wait long
+			const float holdLimit = result.inDanger ? kTooCloseHoldSec : kDeadlockSec;
+			if (now - holdStartTime[id] > holdLimit && result.yieldingTo >= 0) {
+				resolveDeadlock(r, *robotsById[result.yieldingTo]);
+				holdStartTime.erase(id);
+			}
+		} else if (!moving || now - lastHoldTime[id] > kHoldReleaseSec) {
+			// Creeping forward a frame at a time is still being held
+			holdStartTime.erase(id);
+		}
+
+		r.speedScale = result.speedScale;
+	}
+
+	// Last resort, everyone backs off to the staging points and tries again
+	if (deadlocked && now - lastRetreatTime > kRetreatCooldownSec) {
+		cout << "Robots deadlocked, retreating to staging points" << endl;
+		for (auto &p : robotsById) {
+			unclaimPath(p.first);
+		}
+		sendRobotsToStaging();
+
+		safetyRetreats++;
+		lastRetreatTime = now;
+		holdStartTime.clear();
+		dangerStartTime.clear();
+	}
+}
+
+static ofVec2f insideRetreatBox(const ofVec2f &p) {
+	return ofVec2f(ofClamp(p.x, kRetreatCornerBox.getLeft(), kRetreatCornerBox.getRight()),
+				   ofClamp(p.y, kRetreatCornerBox.getTop(), kRetreatCornerBox.getBottom()));
+}
 
-				sendRobotsToCorners();
+// First of the steps, in order of preference, that ends clear of the path
+// being made way for and of every other robot and where it's heading,
+// trying twice as far if none do. Failing that, whichever gets closest to
+// clear.
+ofVec2f ofApp::clearStep(const Robot &mover, const vector<ofVec2f> &dirs, float distance, const ofVec2f &pathStart, const ofVec2f &pathEnd) {
+	ofVec2f best = mover.planePos;
+	float bestClearance = -1;
+	for (int i = 0; i < dirs.size() * 2; ++i) {
+		const ofVec2f &dir = dirs[i % dirs.size()];
+		const ofVec2f to = insideRetreatBox(mover.planePos + dir.getNormalized() * distance * (1 + i / dirs.size()));
+
+		float clearance = ReservationTable::segmentDistance(to, to, pathStart, pathEnd);
+		for (auto &p : robotsById) {
+			const Robot &other = *p.second;
+			if (&other == &mover) continue;
+
+			clearance = min(clearance, to.distance(other.planePos));
+			if (other.state == R_POSITIONING || other.state == R_DRAWING) {
+				clearance = min(clearance, to.distance(other.targetPlanePos));
 			}
 		}
 
+		if (clearance >= kRobotOuterSafetyDiameter) {
+			return to;
+		}
+		if (clearance > bestClearance) {
+			bestClearance = clearance;
+			best = to;
+		}
+	}
+	return best;
+}
+
+// r has been held by blocker for too long. An idle blocker steps off r's
+// path, otherwise r gives its segment up and backs away. A pen isn't
+// lifted for a robot that's only settling or calibrating in place.
+void ofApp::resolveDeadlock(Robot &r, Robot &blocker) {
+	if (r.state == R_DRAWING && blocker.state != R_READY_TO_POSITION && blocker.state != R_POSITIONING && blocker.state != R_DRAWING) {
+		return;
+	}
+
+	const ofVec2f away = (blocker.planePos - r.planePos).getNormalized();
+	const ofVec2f perp(-away.y, away.x);
+	const vector<ofVec2f> axes = { ofVec2f(1, 0), ofVec2f(-1, 0), ofVec2f(0, 1), ofVec2f(0, -1) };
+
+	if (blocker.state == R_READY_TO_POSITION) {
+		const ofVec2f path = r.targetPlanePos - r.planePos;
+		const float t = ofClamp(path.dot(blocker.planePos - r.planePos) / max(path.lengthSquared(), 1e-9f), 0, 1);
+		ofVec2f side = blocker.planePos - (r.planePos + path * t);
+		if (side.length() < 1e-3) {
+			side.set(-path.y, path.x);
+		}
+
+		// Against the edge of the box the obvious way may be blocked
+		const ofVec2f sideDir = side.getNormalized();
+		vector<ofVec2f> dirs = { sideDir + away, sideDir, -sideDir + away, -sideDir, away };
+		dirs.insert(dirs.end(), axes.begin(), axes.end());
+
+		cout << "Robot " << blocker.id << " moving out of the way of " << r.id << endl;
+		blocker.navigateTo(clearStep(blocker, dirs, kRobotOuterSafetyDiameter + kBackOffM, r.planePos, r.targetPlanePos));
+		separating.insert(blocker.id);
+	} else {
+		vector<ofVec2f> dirs = { -away, -away + perp, -away - perp, perp, -perp };
+		dirs.insert(dirs.end(), axes.begin(), axes.end());
+
+		cout << "Robot " << r.id << " backing away from " << blocker.id << endl;
+		unclaimPath(r.id);
+		r.navigateTo(clearStep(r, dirs, kBackOffM, blocker.planePos, blocker.targetPlanePos));
+		separating.insert(r.id);
+	}
+}
+
+// r has nothing left it can draw, take on a path type from the most
+// loaded robot. Returns whether there was anything to take.
+bool ofApp::takeOverWork(Robot &r) {
+	const float now = clock->now();
+	if (lastBalanceTime.find(r.id) != lastBalanceTime.end() && now - lastBalanceTime[r.id] < kBalanceIntervalSec) {
+		return true;
+	}
+	lastBalanceTime[r.id] = now;
+
+	map<int, set<string>> pathTypes;
+	for (auto &p : robotsById) {
+		pathTypes[p.first] = p.second->pathTypes;
+	}
+
+	const LoadSteal steal = balancer.steal(r.id, LoadBalancer::remainingLength(*currentMap), pathTypes);
+	if (steal.fromRobotId < 0) {
+		return false;
+	}
+
+	cout << "Robot " << r.id << " taking on " << steal.pathType << " from robot " << steal.fromRobotId << endl;
+	r.addPathType(steal.pathType);
+
+	if (!headless && pathGuis.find(steal.pathType) != pathGuis.end()) {
+		PathGui &pGui = pathGuis[steal.pathType];
+		if (pGui.robotToggles.find(r.id) != pGui.robotToggles.end()) {
+			pGui.robotToggles[r.id]->setChecked(true);
+		}
+	}
+	return true;
+}
+
+// Corners of the retreat box, then evenly spaced along its edges until
+// there's a point for every robot
+static vector<ofVec2f> defaultStagingPoints(int numRobots) {
+	const int perEdge = max(1, (numRobots + 3) / 4);
+	const vector<ofVec2f> corners = { kRetreatCornerBox.getTopLeft(), kRetreatCornerBox.getTopRight(), kRetreatCornerBox.getBottomRight(), kRetreatCornerBox.getBottomLeft() };
+
+	vector<ofVec2f> points;
+	for (int edge = 0; edge < corners.size(); ++edge) {
+		const ofVec2f &from = corners[edge], &to = corners[(edge + 1) % corners.size()];
+		for (int i = 0; i < perEdge; ++i) {
+			points.push_back(from.getInterpolated(to, i / (float)perEdge));
+		}
+	}
+	return points;
+}
+
+void ofApp::sendRobotsToStaging() {
+	const vector<ofVec2f> points = stagingPoints.empty() ? defaultStagingPoints(robotsById.size()) : stagingPoints;
+
+	vector<Robot*> robots;
+	for (auto &p : robotsById) {
+		robots.push_back(p.second);
+	}
+	if (robots.empty() || points.empty()) {
+		return;
+	}
+
+	// Rows have to be the smaller side, extra robots hold where they are
+	const bool byPoint = robots.size() > points.size();
+	vector<vector<float>> cost(byPoint ? points.size() : robots.size());
+	for (int i = 0; i < cost.size(); ++i) {
+		for (int j = 0; j < (byPoint ? robots.size() : points.size()); ++j) {
+			const Robot &r = *robots[byPoint ? j : i];
+			cost[i].push_back(r.planePos.distance(points[byPoint ? i : j]));
+		}
+	}
+
+	const vector<int> match = kStagingMinimizeMax ? minMaxCostAssignment(cost) : minCostAssignment(cost);
+	if (byPoint) {
+		cout << "Only " << points.size() << " staging points for " << robots.size() << " robots" << endl;
+	}
+
+	set<Robot*> staged;
+	for (int i = 0; i < match.size(); ++i) {
+		Robot &r = *robots[byPoint ? match[i] : i];
+		r.navigateTo(points[byPoint ? i : match[i]]);
+		staged.insert(&r);
+	}
+
+	// Parked, rather than carrying on to wherever they were going
+	for (Robot *r : robots) {
+		if (!staged.count(r)) {
+			r->navigateTo(r->planePos);
+		}
+	}
+}
+
+void ofApp::updateResidentTiles() {
+	vector<pair<ofVec2f, set<string>>> robots;
+	for (auto &p : robotsById) {
+		robots.push_back(make_pair(p.second->avgPlanePos, p.second->pathTypes));
+	}
+
+	// Loading and dropping tiles moves every path, claims are found again by id
+	map<int, int> claimed;
+	for (auto &p : robotPaths) {
+		if (p.second != NULL) claimed[p.first] = p.second->id;
+	}
+	if (!currentMap->updateResidentTiles(robots, kTilePrefetchM)) {
+		return;
+	}
+	for (auto &p : claimed) {
+		robotPaths[p.first] = currentMap->pathById(p.second);
+	}
+}
+
+// Outside the box a robot may turn in place, or head back in
+static bool safeOutsideBox(const Robot &r) {
+	switch (r.state) {
+		case R_STOPPED:
+		case R_START:
+		case R_CALIBRATING_ANGLE:
+		case R_ROTATING_TO_ANGLE:
+		case R_WAITING_ANGLE:
+		case R_READY_TO_POSITION:
+		case R_WAIT_AFTER_POSITION:
+			return true;
+		case R_POSITIONING:
+			return kSafetyBox.inside(r.targetPlanePos);
+		default:
+			return false;
+	}
+}
+
+void ofApp::commandRobots() {
+	MR_PROFILE_SCOPE("ofApp::commandRobots");
+	if (currentMap->isTiled()) {
+		updateResidentTiles();
+	}
+	avoidCollisions();
+
+	// Robots without a segment keep the spot they're on reserved
+	for (auto &p : robotsById) {
+		auto path = robotPaths.find(p.first);
+		if (path == robotPaths.end() || path->second == NULL) {
+			reservations.park(p.first, p.second->avgPlanePos, clock->now());
+		}
+	}
+
+	for (auto &p : robotsById) {
+		int id = p.first;
+		Robot &r = *p.second;
+
 		// Determine draw state
 		if (state == MR_STOPPED) {
 			unclaimPath(id);
@@ -492,30 +1375,24 @@ void ofApp::commandRobots() {
 		} else if (r.state == R_STOPPED && state == MR_RUNNING) {
 			unclaimPath(id);
 			r.start();
-		} else if (!kSafetyBox.inside(r.planePos) && r.state != R_STOPPED) {
+		} else if (!kSafetyBox.inside(r.planePos) && !safeOutsideBox(r)) {
 			r.stop();
 			cout << "Stopping " << id << ", outside the box." << endl;
+		} else if (r.state == R_READY_TO_POSITION && state == MR_RUNNING && !kSafetyBox.inside(r.planePos)) {
+			// Overshot while the camera lost it, come back in before drawing
+			r.navigateTo(insideRetreatBox(r.planePos));
 		} else if (r.state == R_READY_TO_POSITION && state == MR_RUNNING) {
-			MapPath *mp = currentMap->nextPath(r.avgPlanePos, r.id, r.lastHeading, r.pathTypes);
-			robotPaths[id] = mp;
+			MapPath *mp = claimNextPath(r);
 
 			if (mp != NULL) {
-				if (mp->segment.start.distance(r.avgPlanePos) > mp->segment.end.distance(r.avgPlanePos)) {
-					ofVec2f tmp = mp->segment.start;
-					mp->segment.start = mp->segment.end;
-					mp->segment.end = tmp;
-				}
-
-				mp->claimed = true;
 				r.navigateTo(mp->segment.start);
-                r.lastHeading = atan2(mp->segment.end.x - mp->segment.start.x, mp->segment.end.y - mp->segment.start.y)*180/3.14159;
-			} else {
+			} else if (deferStartTime.find(id) == deferStartTime.end() && !(balanceLoad && takeOverWork(r))) {
 				cout << "No more paths to draw!" << endl;
 			}
 		} else if (r.state == R_READY_TO_DRAW && state == MR_RUNNING) {
 			if (robotPaths.find(id) == robotPaths.end()) {
-				// Error!
-				r.stop();
+				// Arrived after backing away or retreating, find something to draw
+				r.setState(R_READY_TO_POSITION);
 			} else {
 				MapPath *mp = robotPaths[id];
 				if (mp == NULL) {
@@ -536,14 +1413,31 @@ void ofApp::commandRobots() {
 					r.stop();
 				} else {
 					mp->drawn = true;
+					journal.record(J_DRAWN, mp->id);
+					r.segmentsDrawn++;
 					robotPaths.erase(robotPaths.find(id));
-                    if (debugging) {
+					// Where the pen really is, before debugging snaps it to the end.
+					// Simulated robots get there for real.
+					const ofVec2f penPos = r.avgPlanePos;
+                    if (debugging && !headless && !SIMULATING) {
                         r.planePos = mp->segment.end;
                         r.avgPlanePos = mp->segment.end;
                         r.slowAvgPlanePos = mp->segment.end;
                     }
-					// TODO: make this a function on robot specifically
-					r.setState(R_READY_TO_POSITION);
+
+					// If the next segment starts where the pen already is, skip
+					// positioning and settling and keep drawing.
+					MapPath *next = state == MR_RUNNING ? claimNextPath(r) : NULL;
+					if (next != NULL && next->segment.start.distance(penPos) < kPositionTolerance) {
+						fastPathCount++;
+						fastPathSavedSec += r.avgSettleSec;
+						r.drawLine(next->segment.start, next->segment.end);
+					} else if (next != NULL) {
+						r.navigateTo(next->segment.start);
+					} else {
+						// TODO: make this a function on robot specifically
+						r.setState(R_READY_TO_POSITION);
+					}
 				}
 			}
 		}
@@ -562,7 +1456,7 @@ void ofApp::commandRobots() {
 		}
 
 
-		if (ofGetElapsedTimef() > 3.0f) {
+		if (clock->now() > 3.0f) {
 			// Record robot location
 			if (robotPositionsCount.find(id) == robotPositionsCount.end()) {
 				robotPositions[id].reserve(kNumPathsToSave);
@@ -579,11 +1473,12 @@ void ofApp::commandRobots() {
 }
 
 void ofApp::updateGui() {
+	MR_PROFILE_SCOPE("ofApp::updateGui");
 	char buf[1024];
-	sprintf(buf, "MR: %s (%.2f)", stateString().c_str(), ofGetElapsedTimef() - stateStartTime);
+	sprintf(buf, "MR: %s (%.2f)", stateString().c_str(), clock->now() - stateStartTime);
 	stateLabel->setLabel(buf);
 
-	sprintf(buf, "RPi: %s (%.2f)", rpiStateToString(rpiState).c_str(), ofGetElapsedTimef() - rpiLastStateMessageTime);
+	sprintf(buf, "RPi: %s (%.2f)", rpiStateToString(rpiState).c_str(), clock->now() - rpiLastStateMessageTime);
 	rpiStateLabel->setLabel(buf);
     
     pathLabel->setLabel("Total Active Paths: " + ofToString(currentMap->getActivePathCount()));
@@ -598,6 +1493,24 @@ void ofApp::updateGui() {
     
     sprintf(buf, "Active Paths Remaining %d, percentage drawn: %.1f%%", drawnPaths, percentage * 100);
     drawnPathLabel->setLabel(buf);
+
+	sprintf(buf, "Continued segments: %d, time saved: %.1fs", fastPathCount, fastPathSavedSec);
+	fastPathLabel->setLabel(buf);
+
+#if PROFILING
+	if (ofGetElapsedTimef() - lastProfileGuiTime > kProfileGuiIntervalSec) {
+		lastProfileGuiTime = ofGetElapsedTimef();
+		for (ProfileStage *stage : Profiler::stages()) {
+			if (profileLabels.find(stage->name) == profileLabels.end()) {
+				profileLabels[stage->name] = profileFolder->addLabel(stage->name);
+			}
+
+			const ProfileSummary sum = stage->summary();
+			sprintf(buf, "%s: %.0f / %.0f / %.0f", stage->name.c_str(), sum.p50Us, sum.p99Us, sum.maxUs);
+			profileLabels[stage->name]->setLabel(buf);
+		}
+	}
+#endif
     
 //    static const ofColor enabled(50, 50, 100), disabled(50, 50, 50);
 //    
@@ -609,6 +1522,123 @@ void ofApp::updateGui() {
 //    }
 }
 
+void ofApp::publishMetrics() {
+	if (metricsText.empty()) {
+		if (clock->now() - lastMetricsTime < kMetricsIntervalSec) {
+			return;
+		}
+		lastMetricsTime = clock->now();
+		metricsText = buildMetrics();
+	}
+
+	// If the server is mid-copy keep the text and hand it over next frame
+	if (metricsServer.publish(metricsText)) {
+		metricsText.clear();
+	}
+}
+
+// Prometheus text format, one block per metric
+string ofApp::buildMetrics() {
+	const float now = clock->now();
+
+	map<int, float> commandRate, segmentRate;
+	for (auto &p : robotsById) {
+		Robot &r = *p.second;
+		deque<RobotMetricsSample> &samples = metricsSamples[p.first];
+		samples.push_back({ now, r.segmentsDrawn, r.messagesSent });
+		while (samples.size() > 2 && now - samples.front().time > kMetricsRateWindowSec) {
+			samples.pop_front();
+		}
+
+		const float dt = now - samples.front().time;
+		commandRate[p.first] = dt > 0 ? (r.messagesSent - samples.front().messagesSent) / dt : 0;
+		segmentRate[p.first] = dt > 0 ? (r.segmentsDrawn - samples.front().segmentsDrawn) / dt * 60.0 : 0;
+	}
+
+	stringstream m;
+	auto robotMetric = [&](const string &name, const string &type, const string &help, function<float(Robot &)> value) {
+		m << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+		for (auto &p : robotsById) {
+			Robot &r = *p.second;
+			m << name << "{robot=\"" << r.id << "\",name=\"" << r.name << "\"} " << value(r) << "\n";
+		}
+	};
+
+	robotMetric("maproom_robot_cv_framerate", "gauge", "Camera updates per second",
+				[](Robot &r) { return r.cvFramerate; });
+	robotMetric("maproom_robot_heartbeat_age_seconds", "gauge", "Time since the last heartbeat",
+				[now](Robot &r) { return now - r.lastHeartbeatTime; });
+	robotMetric("maproom_robot_commands_sent_total", "counter", "Messages sent to the robot",
+				[](Robot &r) { return (float)r.messagesSent; });
+	robotMetric("maproom_robot_commands_per_second", "gauge", "Send rate over the last minute",
+				[&commandRate](Robot &r) { return commandRate[r.id]; });
+	robotMetric("maproom_robot_segments_drawn_total", "counter", "Segments finished",
+				[](Robot &r) { return (float)r.segmentsDrawn; });
+	robotMetric("maproom_robot_segments_per_minute", "gauge", "Segments finished over the last minute",
+				[&segmentRate](Robot &r) { return segmentRate[r.id]; });
+
+	map<int, set<string>> pathTypes;
+	for (auto &p : robotsById) {
+		pathTypes[p.first] = p.second->pathTypes;
+	}
+	map<int, float> load = LoadBalancer::loadByRobot(LoadBalancer::remainingLength(*currentMap), pathTypes);
+	robotMetric("maproom_robot_remaining_length_meters", "gauge", "Robot's share of the undrawn path length",
+				[&load](Robot &r) { return load[r.id]; });
+
+	m << "# HELP maproom_robot_state_seconds_total Time spent in each state\n# TYPE maproom_robot_state_seconds_total counter\n";
+	for (auto &p : robotsById) {
+		Robot &r = *p.second;
+		for (int s = R_NO_CONN; s <= R_STOPPED; ++s) {
+			m << "maproom_robot_state_seconds_total{robot=\"" << r.id << "\",name=\"" << r.name << "\",state=\""
+				<< Robot::stateString((RobotState)s) << "\"} " << r.timeInState((RobotState)s) << "\n";
+		}
+	}
+
+	m << "# HELP maproom_robot_state Current state\n# TYPE maproom_robot_state gauge\n";
+	for (auto &p : robotsById) {
+		Robot &r = *p.second;
+		m << "maproom_robot_state{robot=\"" << r.id << "\",name=\"" << r.name << "\",state=\"" << r.stateString() << "\"} 1\n";
+	}
+
+	const int active = currentMap->getActivePathCount();
+	const int drawn = currentMap->getDrawnPaths();
+	m << "# TYPE maproom_job_segments_active gauge\nmaproom_job_segments_active " << active << "\n"
+		<< "# TYPE maproom_job_segments_drawn gauge\nmaproom_job_segments_drawn " << drawn << "\n"
+		<< "# TYPE maproom_job_segments_remaining gauge\nmaproom_job_segments_remaining " << active - drawn << "\n"
+		<< "# TYPE maproom_job_continued_segments_total counter\nmaproom_job_continued_segments_total " << fastPathCount << "\n"
+		<< "# TYPE maproom_job_safety_retreats_total counter\nmaproom_job_safety_retreats_total " << safetyRetreats << "\n"
+		<< "# TYPE maproom_job_safety_stops_total counter\nmaproom_job_safety_stops_total " << safetyStops << "\n"
+		<< "# TYPE maproom_job_safety_yields_total counter\nmaproom_job_safety_yields_total " << safetyYields << "\n"
+		<< "# TYPE maproom_job_reservation_deferrals_total counter\nmaproom_job_reservation_deferrals_total " << reservationDeferrals << "\n"
+		<< "# TYPE maproom_job_load_steals_total counter\nmaproom_job_load_steals_total " << balancer.steals << "\n"
+		<< "# TYPE maproom_udp_messages_sent_total counter\nmaproom_udp_messages_sent_total " << robotSender.messagesSent << "\n"
+		<< "# TYPE maproom_udp_send_calls_total counter\nmaproom_udp_send_calls_total " << robotSender.sendCalls << "\n"
+		<< "# TYPE maproom_udp_send_errors_total counter\nmaproom_udp_send_errors_total " << robotSender.sendErrors << "\n"
+		<< "# TYPE maproom_map_resident_tiles gauge\nmaproom_map_resident_tiles " << currentMap->residentTileCount() << "\n"
+		<< "# TYPE maproom_map_tile_loads_total counter\nmaproom_map_tile_loads_total " << currentMap->tileLoads << "\n"
+		<< "# TYPE maproom_map_tile_writes_total counter\nmaproom_map_tile_writes_total " << currentMap->tileWrites << "\n"
+		<< "# TYPE maproom_journal_records_total counter\nmaproom_journal_records_total " << journal.records << "\n"
+		<< "# TYPE maproom_journal_snapshots_total counter\nmaproom_journal_snapshots_total " << journal.snapshots << "\n"
+		<< "# TYPE maproom_job_state gauge\nmaproom_job_state{state=\"" << stateString() << "\"} 1\n";
+
+	m << "# TYPE maproom_loop_frame_seconds gauge\nmaproom_loop_frame_seconds " << ofGetLastFrameTime() << "\n"
+		<< "# TYPE maproom_loop_fps gauge\nmaproom_loop_fps " << ofGetFrameRate() << "\n";
+
+#if PROFILING
+	m << "# HELP maproom_stage_latency_us Stage latency since the last reset\n# TYPE maproom_stage_latency_us summary\n";
+	for (ProfileStage *stage : Profiler::stages()) {
+		const ProfileSummary sum = stage->summary();
+		const string label = "maproom_stage_latency_us{stage=\"" + stage->name + "\"";
+		m << label << ",quantile=\"0.5\"} " << sum.p50Us << "\n"
+			<< label << ",quantile=\"0.99\"} " << sum.p99Us << "\n"
+			<< label << ",quantile=\"1\"} " << sum.maxUs << "\n"
+			<< "maproom_stage_latency_us_count{stage=\"" << stage->name << "\"} " << sum.count << "\n";
+	}
+#endif
+
+	return m.str();
+}
+
 string ofApp::stateString() {
 	switch(state) {
 		case MR_STOPPED:
@@ -624,6 +1654,7 @@ string ofApp::stateString() {
 
 //--------------------------------------------------------------
 void ofApp::draw(){
+	MR_PROFILE_SCOPE("ofApp::draw");
 	stringstream posstr;
 
 	cam.begin();
@@ -733,11 +1764,11 @@ void ofApp::draw(){
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key){
 	if (key == 'g') {
-		setState(MR_RUNNING);
+		runCommand("state " + ofToString(MR_RUNNING));
 	} else if (key == ' ') {
-		setState(MR_PAUSED);
+		runCommand("state " + ofToString(MR_PAUSED));
 	} else if (key == 'x') {
-		setState(MR_STOPPED);
+		runCommand("state " + ofToString(MR_STOPPED));
 	}
 }
 
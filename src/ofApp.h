@@ -10,6 +10,17 @@
 #include "Robot.h"
 #include "Map.h"
 #include "ArucoMarker.h"
+#include "Simulator.h"
+#include "InputLog.h"
+#include "MetricsServer.h"
+#include "CollisionAvoidance.h"
+#include "ReservationTable.h"
+#include "LoadBalancer.h"
+#include "FleetConfig.h"
+#include "RobotSender.h"
+#include "ProgressJournal.h"
+#include "MapWatcher.h"
+#include "MapLoader.h"
 
 #define PORT 5100
 
@@ -37,12 +48,18 @@ typedef struct RobotGui {
 	ofxDatGuiSlider *rotationAngleSlider;
 } RobotGui;
 
+// Counters at one metrics publish, for rates over the last minute
+typedef struct RobotMetricsSample {
+	float time;
+	int segmentsDrawn, messagesSent;
+} RobotMetricsSample;
+
 typedef struct PathGui {
 	string pathType;
 	ofxDatGuiFolder *folder;
     ofxDatGuiToggle *toggle;
 
-    vector<ofxDatGuiToggle *> robotSelect;
+    map<int, ofxDatGuiToggle *> robotToggles;
 //    ofxDatGuiDropdown *drawOptions;
 } PathGui;
 
@@ -66,19 +83,64 @@ class ofApp : public ofBaseApp{
 		void dragEvent(ofDragInfo dragInfo);
 		void gotMessage(ofMessage msg);
 
+	// Run without a window or GUI, driven by the caller, e.g. benchmarks
+	void setupHeadless(Clock *clock, SimClock *simClock, Simulator *simulator);
+	void addRobot(Robot *r);
+	void addRobotGui(Robot &r);
+	void stepSimulation(float dt);
+
+	// Robots from a fleet config, see FleetConfig.h. Ones already running
+	// only pick up a new address, so a reload hot-adds the rest.
+	bool loadFleet(const string &path);
+	void addFleet(const vector<RobotConfig> &fleet);
+
 	void setState(MaproomState newState);
 	string stateString();
 	void updateGui();
     
 	void handleOSC();
+	void handleCameraMessage(const string &json);
+	void handleStateMessage(const string &json);
 	void receiveFromRobots();
+	void handleRobotMessage(char *message, int length);
 	void commandRobots();
-	void sendRobotsToCorners();
+	void updateResidentTiles();
+	void avoidCollisions();
+	void resolveDeadlock(Robot &r, Robot &blocker);
+	ofVec2f clearStep(const Robot &mover, const vector<ofVec2f> &dirs, float distance, const ofVec2f &pathStart, const ofVec2f &pathEnd);
+	void sendRobotsToStaging();
+	bool takeOverWork(Robot &r);
+
+	// Where robots retreat to, one each, from the fleet config. Empty
+	// spreads them around the edge of the canvas.
+	vector<ofVec2f> stagingPoints;
+
+	// GUI and keyboard actions, recorded so a replay can repeat them
+	void runCommand(const string &command);
+
+	// Replay an input log instead of listening to the camera and robots.
+	// Set replayPath before setup to replay in the GUI, replayFast to not
+	// wait on the recorded timestamps.
+	bool startReplay(const string &path, ReplayClock *replayClock);
+	bool replayFrame();
+	string replayPath;
+	bool replayFast;
+
+	// Plain-text metrics for scraping, served from another thread
+	void publishMetrics();
+	string buildMetrics();
 
 	void loadMap(const string &newMapPath);
+	// Starts loading a new version of the map, and swaps it in keeping the
+	// progress made once it's loaded
+	void mergeMap(const string &newMapPath);
+	void finishMerge(const string &newMapPath);
+	void loadTuningProfile(const string &path);
 	void setupMapGui();
     
 	void unclaimPath(int robotId);
+	MapPath* claimNextPath(Robot &r);
+	void resetJobCounters();
     
     // path gui
     // int dropdown_index, int robot_id
@@ -86,6 +148,9 @@ class ofApp : public ofBaseApp{
 
 
 private:
+	friend class JobBenchmark;
+	friend class ReplayBenchmark;
+
 	ofEasyCam cam;
 
 	ofxOscReceiver oscReceiver;
@@ -93,6 +158,7 @@ private:
 	ofxJSONElement jsonMsg;
 
 	ofxUDPManager robotReceiver;
+	RobotSender robotSender;
 	char robotMessage[1024];
 
 	map<int, Robot*> robotsById;
@@ -106,21 +172,79 @@ private:
 	ofxDatGui *gui;
     ofxDatGuiLog *guiLogger;
     ofxDatGui *pathGui;
-	ofxDatGuiLabel *stateLabel, *pathLabel, *drawnPathLabel, *pathStatusLabel;
+	ofxDatGuiLabel *stateLabel, *pathLabel, *drawnPathLabel, *pathStatusLabel, *fastPathLabel;
 	ofxDatGuiButton *startButton, *pauseButton, *stopButton;
 	ofxDatGuiLabel *rpiStateLabel;
 	ofxDatGuiDropdown *rpiStateDropdown;
 	ofxDatGuiFolder *robotConstantsFolder;
 	ofxDatGuiSlider *kpSlider, *kiSlider, *kdSlider, *kMaxISlider;
 	ofxDatGuiSlider *minSpeedSlider, *maxSpeedSlider, *speedRampSlider;
+	ofxDatGuiSlider *maxAccelSlider, *maxJerkSlider;
+	ofxDatGuiToggle *mpcToggle;
+	ofxDatGuiToggle *balanceToggle;
+#if PROFILING
+	ofxDatGuiFolder *profileFolder;
+	map<string, ofxDatGuiLabel*> profileLabels;
+	float lastProfileGuiTime;
+#endif
 	map<int, RobotGui> robotGuis;
 	map<string, PathGui> pathGuis;
 
 	map<int, ArucoMarker> markersById;
 
+	bool headless;
+	Clock *clock;
+	SimClock *simClock;
+	Simulator *simulator;
+
+	MetricsServer metricsServer;
+	string metricsText;
+	float lastMetricsTime;
+	map<int, deque<RobotMetricsSample>> metricsSamples;
+
+	InputRecorder recorder;
+	InputReplayer *replayer;
+	ReplayClock *replayClock;
+	double replayOffset;
+
 	string mapPath;
     Map *currentMap;
 
+	// Segment progress for the loaded map, off when replaying or headless
+	ProgressJournal journal;
+	bool journaling;
+	// New map versions turning up in downloads, and being loaded to merge
+	MapWatcher watcher;
+	MapLoader mapLoader;
+
+	// Slow or hold robots that are about to collide
+	CollisionAvoidance collisions;
+	set<int> robotsInDanger;
+	map<int, float> holdStartTime, lastHoldTime, dangerStartTime;
+	// Backing off after resolveDeadlock, until they get there
+	set<int> separating;
+	float lastRetreatTime;
+
+	// Corridors robots will sweep for their segments, so nextPath doesn't
+	// hand out one that crosses another robot's
+	ReservationTable reservations;
+	map<int, float> deferStartTime;
+
+	// Idle robots take path types over from busy ones
+	LoadBalancer balancer;
+	bool balanceLoad;
+	map<int, float> lastBalanceTime;
+
+	// Times robots retreated to the corners, got inside each other's safety
+	// zone, and held still to let another robot pass
+	int safetyRetreats, safetyStops, safetyYields;
+	// Times a robot had to wait for a segment clear of other robots
+	int reservationDeferrals;
+
+	// Segments started straight from the end of the previous one
+	int fastPathCount;
+	float fastPathSavedSec;
+
 	MaproomState state;
 	float stateStartTime;
 